@@ -0,0 +1,243 @@
+#include "analytics.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+
+using namespace std;
+
+typedef unsigned __int128 uint128;
+
+static uint64_t moves_of(int n)
+{
+    return (n >= 64) ? ~(uint64_t)0 : ((uint64_t)1 << n) - 1;
+}
+
+//Moves of disc i among the first k moves: floor((k + 2^i) / 2^(i+1))
+static uint64_t disc_moves_before(int i, uint64_t k)
+{
+    return (i < 63 ? k >> (i + 1) : 0) + ((k >> i) & 1);
+}
+
+//Axis cycle step of disc i: +2 (0 -> 2 -> 1) when n - i is odd, +1 otherwise
+static unsigned disc_step(int n, int i)
+{
+    return ((n - i) & 1) ? 2 : 1;
+}
+
+//States k < K after which disc i has made a number of moves = r (mod 3). With
+//x = k + 2^i the move count is floor(x / 2^(i+1)), so this counts the x in
+//[2^i, K + 2^i) on the r-th of every three runs of 2^(i+1)
+static uint64_t disc_time_before(int i, uint64_t K, unsigned r)
+{
+    uint128 run = (uint128)2 << i;
+    uint128 x = (uint128)K + (run >> 1);
+    uint128 rem = x % (3 * run);
+    uint128 partial = (rem > r * run) ? rem - r * run : 0;
+    uint128 count = x / (3 * run) * run + (partial < run ? partial : run);
+    if (r == 0)
+        count -= run >> 1;    // x < 2^i are not states
+    return (uint64_t)count;
+}
+
+//full[m][role][h]: states of a whole transfer of m discs with h of them on its
+//source (role 0), target (1) and spare (2) axis
+typedef vector<vector<uint64_t> > Histogram;
+
+static vector<Histogram> full_histograms(int n)
+{
+    vector<Histogram> full(n, Histogram(3));
+    for (int m = 0; m < n; m++)
+        for (int r = 0; r < 3; r++)
+            full[m][r].assign(m + 1, 0);
+    for (int r = 0; r < 3; r++)
+        full[0][r][0] = 1;
+
+    //Transfer src -> tgt: src -> spare over the largest disc on src, then spare -> tgt over it on tgt
+    for (int m = 1; m < n; m++)
+    {
+        Histogram const& sub = full[m - 1];
+        Histogram& h = full[m];
+        for (int j = 0; j < m; j++)
+        {
+            h[0][j + 1] += sub[0][j];
+            h[0][j] += sub[2][j];
+            h[1][j] += sub[2][j];
+            h[1][j + 1] += sub[1][j];
+            h[2][j] += sub[1][j];
+            h[2][j] += sub[0][j];
+        }
+    }
+    return full;
+}
+
+//Adds the heights of the states after 0 .. K - 1 moves, sign -1 subtracts them
+static void add_height_prefix(int n, uint64_t K, vector<Histogram> const& full, Histogram& out, int sign)
+{
+    int src = 0, tgt = 2, spare = 1;
+    int below[3] = { 0, 0, 0 };    // Larger discs already placed on each axis
+    for (int m = n; m > 0 && K > 0; m--)
+    {
+        uint64_t half = (uint64_t)1 << (m - 1);
+        if (K <= half) {
+            below[src]++;
+            swap(tgt, spare);
+            continue;
+        }
+
+        //Whole first half: sub-transfer src -> spare, the largest disc on src
+        below[src]++;
+        int role[3];
+        role[src] = 0;
+        role[spare] = 1;
+        role[tgt] = 2;
+        for (int a = 0; a < 3; a++)
+            for (int h = 0; h < m; h++)
+                out[a][h + below[a]] += sign * full[m - 1][role[a]][h];
+        below[src]--;
+
+        //Into the second half: spare -> tgt, the largest disc on tgt
+        K -= half;
+        below[tgt]++;
+        int s = src;
+        src = spare;
+        spare = s;
+    }
+    if (K > 0)
+        for (int a = 0; a < 3; a++)
+            out[a][below[a]] += sign;
+}
+
+bool solution_stats(int n, uint64_t k0, uint64_t k1, SolutionStats& out)
+{
+    if (n < 1 || n > 64 || k0 > k1 || k1 > moves_of(n))
+        return false;
+
+    out.n = n;
+    out.k0 = k0;
+    out.k1 = k1;
+    out.disc_moves.assign(n, 0);
+    for (int f = 0; f < 3; f++)
+        for (int t = 0; t < 3; t++)
+            out.move_types[f][t] = 0;
+
+    for (int a = 0; a < 3; a++)
+        out.peg_time[a].assign(n, 0);
+    for (int i = 0; i < n; i++)
+    {
+        uint64_t j0 = disc_moves_before(i, k0), j1 = disc_moves_before(i, k1);
+        unsigned step = disc_step(n, i);
+        out.disc_moves[i] = j1 - j0;
+
+        //The j-th move of disc i goes from axis (j mod 3) * step to (j mod 3 + 1) * step
+        for (unsigned r = 0; r < 3; r++)
+        {
+            uint64_t count = (j1 / 3 + (j1 % 3 > r)) - (j0 / 3 + (j0 % 3 > r));
+            out.move_types[r * step % 3][(r + 1) * step % 3] += count;
+            out.peg_time[r * step % 3][i] = disc_time_before(i, k1, r) - disc_time_before(i, k0, r);
+        }
+    }
+
+    vector<Histogram> full = full_histograms(n);
+    Histogram heights(3, vector<uint64_t>(n + 1, 0));
+    add_height_prefix(n, k1, full, heights, 1);
+    add_height_prefix(n, k0, full, heights, -1);
+    for (int a = 0; a < 3; a++)
+        out.peg_height[a] = heights[a];
+    return true;
+}
+
+void print_solution_stats(SolutionStats const& s, ostream& out)
+{
+    out << "Estatisticas de " << s.n << " discos, movimentos [" << s.k0 << ", " << s.k1 << ")" << endl;
+    out << "Movimentos por tipo:";
+    for (int f = 0; f < 3; f++)
+        for (int t = 0; t < 3; t++)
+            if (f != t) out << "  " << f << "->" << t << ": " << s.move_types[f][t];
+    out << endl;
+    out << "Disco\tMovimentos\tTempo na haste 0/1/2" << endl;
+    for (int i = 0; i < s.n; i++)
+        out << i << "\t" << s.disc_moves[i] << "\t\t" << s.peg_time[0][i] << " / "
+            << s.peg_time[1][i] << " / " << s.peg_time[2][i] << endl;
+    out << "Altura\tHaste 0/1/2" << endl;
+    for (int h = 0; h <= s.n; h++)
+        if (s.peg_height[0][h] || s.peg_height[1][h] || s.peg_height[2][h])
+            out << h << "\t" << s.peg_height[0][h] << " / " << s.peg_height[1][h] << " / " << s.peg_height[2][h] << endl;
+}
+
+static void json_array(string& out, vector<uint64_t> const& v)
+{
+    char buf[24];
+    out += "[";
+    for (size_t i = 0; i < v.size(); i++)
+    {
+        snprintf(buf, sizeof(buf), "%s%llu", i ? ", " : "", (unsigned long long)v[i]);
+        out += buf;
+    }
+    out += "]";
+}
+
+void solution_stats_json(SolutionStats const& s, string& out)
+{
+    char buf[128];
+    snprintf(buf, sizeof(buf), "{\n  \"discs\": %d,\n  \"k0\": %llu,\n  \"k1\": %llu,\n  \"disc_moves\": ",
+             s.n, (unsigned long long)s.k0, (unsigned long long)s.k1);
+    out += buf;
+    json_array(out, s.disc_moves);
+
+    out += ",\n  \"move_types\": {";
+    bool first = true;
+    for (int f = 0; f < 3; f++)
+        for (int t = 0; t < 3; t++)
+            if (f != t) {
+                snprintf(buf, sizeof(buf), "%s\"%d->%d\": %llu", first ? "" : ", ", f, t,
+                         (unsigned long long)s.move_types[f][t]);
+                out += buf;
+                first = false;
+            }
+
+    out += "},\n  \"peg_time\": [";
+    for (int a = 0; a < 3; a++)
+    {
+        out += a ? ", " : "";
+        json_array(out, s.peg_time[a]);
+    }
+    out += "],\n  \"peg_height\": [";
+    for (int a = 0; a < 3; a++)
+    {
+        out += a ? ", " : "";
+        json_array(out, s.peg_height[a]);
+    }
+    out += "]\n}\n";
+}
+
+int stats_main(int argc, char** argv)
+{
+    int n = 0;
+    uint64_t k0 = 0, k1 = 0;
+    int bounds = 0;
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+        if (arg == "--stats" && i + 1 < argc) {
+            n = atoi(argv[++i]);
+            if (i + 2 < argc && argv[i + 1][0] != '-') {
+                k0 = strtoull(argv[++i], NULL, 10);
+                k1 = strtoull(argv[++i], NULL, 10);
+                bounds = 1;
+            }
+        }
+    }
+    if (n >= 1 && n <= 64 && !bounds)
+        k1 = moves_of(n);
+
+    SolutionStats s;
+    if (!solution_stats(n, k0, k1, s)) {
+        cerr << "Uso: hanoi --stats N [K0 K1], 1 <= N <= 64 e K0 <= K1 <= 2^N - 1" << endl;
+        return 1;
+    }
+    string json;
+    solution_stats_json(s, json);
+    cout << json;
+    return 0;
+}
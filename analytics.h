@@ -0,0 +1,37 @@
+#ifndef HANOI_ANALYTICS_H
+#define HANOI_ANALYTICS_H
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Statistics of the classic transfer of n <= 64 discs from axis 0 to axis 2
+// over the moves k0 .. k1 - 1 and the states after k0 .. k1 - 1 moves, from
+// the closed forms instead of a scan of the moves. Disc i has made
+// floor((k + 2^i) / 2^(i+1)) moves after k moves and cycles the axis in a
+// fixed direction, which gives its moves, move types and time per axis in
+// O(1). The heights follow the recursion of the solution: the first half is a
+// transfer 0 -> 1 of n - 1 discs over the largest disc on axis 0, the second
+// half a transfer 1 -> 2 over it on axis 2, so a prefix splits into at most
+// one whole sub-transfer per level, whose histogram is tabulated. O(n^2).
+struct SolutionStats {
+    int n;
+    uint64_t k0, k1;
+    std::vector<uint64_t> disc_moves;      // Moves of disc i
+    uint64_t move_types[3][3];             // Moves from axis f to axis t
+    std::vector<uint64_t> peg_time[3];     // [a][i]: states with disc i on axis a
+    std::vector<uint64_t> peg_height[3];   // [a][h]: states with h discs on axis a
+};
+
+// False unless 1 <= n <= 64 and k0 <= k1 <= 2^n - 1
+bool solution_stats(int n, uint64_t k0, uint64_t k1, SolutionStats& out);
+
+void print_solution_stats(SolutionStats const& s, std::ostream& out);
+void solution_stats_json(SolutionStats const& s, std::string& out);
+
+// hanoi --stats N [K0 K1]: prints the statistics of the whole solution, or of
+// the moves [K0, K1), as JSON on stdout
+int stats_main(int argc, char** argv);
+
+#endif
@@ -0,0 +1,308 @@
+// Benchmark suite: ./build_n_bench.sh [--samples N] [--no-frames]
+//
+// Microbenchmarks of the solver, move_disc, the spline, the per-tick update
+// and the simulation core on a virtual clock or in compressed playback, plus a frame-time benchmark of
+// display_handler in a hidden GLUT window. Every benchmark is sampled repeatedly after a warm-up, and the
+// median and the median absolute deviation of the samples are printed as JSON.
+
+#define HANOI_BENCHMARK
+#include "main.cpp"
+#include "libhanoi.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+struct BenchResult {
+    string name;
+    string unit;
+    double median, mad;
+    size_t samples;
+};
+
+vector<BenchResult> results;
+size_t bench_samples = 31;
+
+double now_ns()
+{
+    return chrono::duration<double, nano>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+double median_of(vector<double> v)
+{
+    sort(v.begin(), v.end());
+    size_t m = v.size() / 2;
+    return (v.size() % 2) ? v[m] : (v[m - 1] + v[m]) / 2.0;
+}
+
+// Runs body once to warm up, then once per sample; body returns the number of ops it performed
+template <typename Body>
+void run_bench(string const& name, string const& unit, Body body)
+{
+    vector<double> per_op;
+    body();
+    for (size_t s = 0; s < bench_samples; s++)
+    {
+        double start = now_ns();
+        double ops = body();
+        per_op.push_back((now_ns() - start) / ops);
+    }
+
+    BenchResult r;
+    r.name = name;
+    r.unit = unit;
+    r.median = median_of(per_op);
+    vector<double> dev(per_op.size());
+    for (size_t i = 0; i < per_op.size(); i++)
+        dev[i] = fabs(per_op[i] - r.median);
+    r.mad = median_of(dev);
+    r.samples = per_op.size();
+    results.push_back(r);
+    cerr << name << ": " << r.median << " " << unit << " (MAD " << r.mad << ")" << endl;
+}
+
+// Keeps the optimiser from discarding benchmarked results
+volatile uint64_t bench_sink;
+
+// Scene of side x side boards of n discs, without console output
+void bench_scene(size_t side, size_t n)
+{
+    sim.grid_cols = sim.grid_rows = side;
+    sim.grid_min_discs = sim.grid_max_discs = n;
+    initialize_game();
+    for (size_t k = 0; k < sim.puzzles.size(); k++)
+        sim.puzzles[k].verbose = false;
+}
+
+void bench_solver()
+{
+    run_bench("move_stack_build_n64", "ns/op", []() {
+        double ops = 0;
+        for (int i = 0; i < 200; i++, ops++)
+        {
+            SolutionGrammar g;
+            bench_sink += move_stack(g, 64, 0, 2);
+        }
+        return ops;
+    });
+
+    SolutionGrammar g;
+    SolutionGrammar::symbol root = move_stack(g, 20, 0, 2);
+    run_bench("move_generation_cursor_n20", "ns/move", [&]() {
+        uint64_t sum = 0;
+        SolutionCursor c(&g, root);
+        for (; !c.empty(); c.pop_front())
+            sum += c.front().t;
+        bench_sink += sum;
+        return (double)g.length(root);
+    });
+
+    SolutionGrammar::symbol adjacent = variant_stack(g, V_ADJACENT, 13);
+    run_bench("move_generation_cursor_adjacent_n13", "ns/move", [&]() {
+        uint64_t sum = 0;
+        SolutionCursor c(&g, adjacent);
+        for (; !c.empty(); c.pop_front())
+            sum += c.front().t;
+        bench_sink += sum;
+        return (double)g.length(adjacent);
+    });
+
+    //The C API in batches of 4096 moves, each call seeking from scratch
+    vector<libhanoi_move> batch(4096);
+    run_bench("libhanoi_moves_batch4096_n20", "ns/move", [&]() {
+        uint64_t total = libhanoi_move_count(LIBHANOI_CLASSIC, 20);
+        for (uint64_t k = 0; k < total; k += batch.size())
+            libhanoi_moves(LIBHANOI_CLASSIC, 20, k, min(total, k + batch.size()), batch.data());
+        bench_sink += batch[0].to;
+        return (double)total;
+    });
+
+    run_bench("move_generation_kth_n64", "ns/move", []() {
+        uint64_t sum = 0;
+        const int ops = 1 << 20;
+        for (uint64_t k = 0; k < ops; k++)
+            sum += hanoi_kth_move(64, k * 0x9E3779B97F4A7C15ull % ~(uint64_t)0).t;
+        bench_sink += sum;
+        return (double)ops;
+    });
+
+    vector<uint64_t> ks(4096);
+    for (size_t j = 0; j < ks.size(); j++)
+        ks[j] = j * 0x9E3779B97F4A7C15ull;
+    vector<uint8_t> states(ks.size() * 64);
+    run_bench("states_batch_n64", "ns/state", [&]() {
+        hanoi_states_batch(64, ks.data(), ks.size(), states.data());
+        bench_sink += states[ks.size() * 32];
+        return (double)ks.size();
+    });
+    run_bench("states_batch_scalar_n64", "ns/state", [&]() {
+        hanoi_states_batch_scalar(64, ks.data(), ks.size(), states.data());
+        bench_sink += states[ks.size() * 32];
+        return (double)ks.size();
+    });
+}
+
+void bench_move_disc()
+{
+    bench_scene(1, 20);
+    Puzzle& p = sim.puzzles[0];
+    SolutionGrammar g;
+    SolutionGrammar::symbol root = move_stack(g, 20, 0, 2);
+
+    run_bench("move_disc_n20", "ns/move", [&]() {
+        initialize_puzzle(sim, p, 20);
+        for (SolutionCursor c(&g, root); !c.empty(); c.pop_front())
+        {
+            move_disc(p, c.front().f, c.front().t);
+            p.active_discs.clear();
+        }
+        return (double)g.length(root);
+    });
+}
+
+void bench_interpolation()
+{
+    GameBoard const& board = sim.puzzles[0].board;
+    CustomPoint sp = board.axis[0].positions[0], tp = board.axis[2].positions[0];
+    run_bench("get_inerpolated_coordinate", "ns/call", [&]() {
+        const int ops = 1 << 20;
+        double sum = 0;
+        for (int i = 0; i < ops; i++)
+            sum += get_inerpolated_coordinate(board, sp, tp, (i & 1023) / 1023.0).z;
+        bench_sink += (uint64_t)sum;
+        return (double)ops;
+    });
+}
+
+// The per-tick update anim_handler runs for every board, on a grid solving in parallel.
+// 12 discs keep every board busy for all the samples.
+void bench_anim_tick(size_t side, size_t depth)
+{
+    bench_scene(side, 12);
+    sim.pipeline_depth = depth;
+    solve();
+
+    char name[64];
+    snprintf(name, sizeof(name), "anim_tick_%zux%zu_pipeline%zu", side, side, depth);
+    run_bench(name, "ns/tick", []() {
+        const int ticks = 2000;
+        for (int t = 0; t < ticks; t++)
+            step_simulation(sim);
+        return (double)ticks;
+    });
+    sim.pipeline_depth = 1;
+}
+
+// The core without a window: a virtual clock advanced by 1 ms per iteration at 1000 ticks per second
+void bench_virtual_clock()
+{
+    VirtualClock clock;
+    bench_scene(1, 20);
+    sim.clock = &clock;
+    sim.FPS = 1000;
+    solve();
+
+    run_bench("virtual_clock_tick_1x1_n20", "ns/tick", [&]() {
+        const int ticks = 1 << 20;
+        for (int t = 0; t < ticks; t++)
+        {
+            clock.advance(1);
+            if (tick_due(sim))
+                step_simulation(sim);
+        }
+        return (double)ticks;
+    });
+    sim.clock = NULL;
+    sim.FPS = 60;
+}
+
+// Compressed playback of 64 discs: the ticks that apply a sub-tower of up to 2^32 moves cost no more than the others
+void bench_compressed_tick()
+{
+    bench_scene(1, 64);
+    sim.compress_moves = (uint64_t)1 << 32;
+    sim.puzzles[0].start_delay = 0;
+    solve();
+
+    run_bench("compressed_tick_1x1_n64", "ns/tick", []() {
+        const int ticks = 1 << 16;
+        for (int t = 0; t < ticks; t++)
+            step_simulation(sim);
+        return (double)ticks;
+    });
+    cerr << "compressed_tick_1x1_n64: " << sim.puzzles[0].sol.position() << " moves played" << endl;
+    sim.compress_moves = 0;
+}
+
+// display_handler in a hidden window, glFinish makes each sample include the GPU work
+void bench_frames(int argc, char** argv)
+{
+    if (!getenv("DISPLAY")) {
+        cerr << "frames: no DISPLAY, skipped" << endl;
+        return;
+    }
+    glutInit(&argc, argv);
+    glutInitDisplayMode(GLUT_RGB | GLUT_DOUBLE | GLUT_DEPTH | GLUT_STENCIL | GLUT_MULTISAMPLE);
+    glutInitWindowSize(window_width, window_height);
+    glutCreateWindow("Torres de Hanoi - benchmark");
+    glutHideWindow();
+
+    size_t counts[] = { 3, 6, 10, 16, 32, 64 };
+    for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); c++)
+    {
+        bench_scene(1, counts[c]);
+        //initialize() multiplies the camera onto the modelview, every count starts from the same one
+        glMatrixMode(GL_MODELVIEW);
+        glLoadIdentity();
+        initialize();
+        reshape_handler(window_width, window_height);
+        findPlane(floorPlane, floorVertices[1], floorVertices[2], floorVertices[3]);
+
+        char name[64];
+        snprintf(name, sizeof(name), "display_handler_n%zu", counts[c]);
+        run_bench(name, "ns/frame", []() {
+            const int frames = 20;
+            for (int f = 0; f < frames; f++)
+                display_handler();
+            glFinish();
+            return (double)frames;
+        });
+    }
+}
+
+void print_json()
+{
+    cout << "{\n  \"samples\": " << bench_samples << ",\n  \"benchmarks\": [\n";
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        BenchResult const& r = results[i];
+        cout << "    {\"name\": \"" << r.name << "\", \"unit\": \"" << r.unit
+             << "\", \"median\": " << r.median << ", \"mad\": " << r.mad
+             << ", \"samples\": " << r.samples << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    cout << "  ]\n}" << endl;
+}
+
+int main(int argc, char** argv)
+{
+    bool frames = true;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--samples") == 0 && i + 1 < argc) bench_samples = max(3, atoi(argv[++i]));
+        else if (strcmp(argv[i], "--no-frames") == 0) frames = false;
+    }
+
+    bench_solver();
+    bench_move_disc();
+    bench_interpolation();
+    bench_anim_tick(1, 1);
+    bench_anim_tick(8, 1);
+    bench_anim_tick(8, PIPELINE_DEPTH);
+    bench_virtual_clock();
+    bench_compressed_tick();
+    if (frames)
+        bench_frames(argc, argv);
+
+    print_json();
+    return 0;
+}
@@ -0,0 +1,12 @@
+#!/usr/bin/env bash
+
+LIB="libhanoi.so"
+ABI=1
+
+# Only the libhanoi_* C functions are exported, the C++ solver stays internal.
+# libhanoi.map also hides the weak template instances (std::vector, std::map)
+# that -fvisibility=hidden alone leaves in the dynamic symbol table.
+# The soname carries LIBHANOI_ABI_VERSION, it changes only when the ABI breaks
+rm -f $LIB $LIB.$ABI;
+g++ -O2 -fPIC -shared -fvisibility=hidden -Wl,--version-script,libhanoi.map -Wl,-soname,$LIB.$ABI -o $LIB.$ABI libhanoi.cpp solution.cpp;
+ln -s $LIB.$ABI $LIB;
@@ -0,0 +1,7 @@
+#!/usr/bin/env bash
+
+APP="hanoi_bench"
+
+rm -f $APP;
+g++ -O2 -o $APP bench.cpp analytics.cpp checkpoint.cpp fourpeg.cpp libhanoi.cpp mesh.cpp server.cpp session.cpp simulation.cpp solution.cpp -lglut -lGLU -lGL -pthread;
+$(command -v optirun) ./$APP "$@"
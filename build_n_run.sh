@@ -3,5 +3,5 @@
 APP="hanoi"
 
 rm -f $APP;
-g++ -o $APP main.cpp -lglut -lGLU -lGL;
+g++ -o $APP main.cpp analytics.cpp checkpoint.cpp fourpeg.cpp mesh.cpp server.cpp session.cpp simulation.cpp solution.cpp -lglut -lGLU -lGL -pthread;
 $(command -v optirun) ./$APP &
\ No newline at end of file
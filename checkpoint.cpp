@@ -0,0 +1,254 @@
+#include "checkpoint.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace std;
+
+static const char CHECKPOINT_MAGIC[4] = { 'H', 'C', 'K', 'P' };
+static const uint16_t CHECKPOINT_VERSION = 3;
+
+void checkpoint_capture(Simulation const& sim, CheckpointView const& view, string& out)
+{
+    CheckpointHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, CHECKPOINT_MAGIC, sizeof(h.magic));
+    h.version = CHECKPOINT_VERSION;
+    h.board_size = sizeof(CheckpointBoard);
+    h.grid_cols = sim.grid_cols;
+    h.grid_rows = sim.grid_rows;
+    h.min_discs = sim.grid_min_discs;
+    h.max_discs = sim.grid_max_discs;
+    h.pipeline_depth = sim.pipeline_depth;
+    h.variant = sim.variant;
+    h.ticks = sim.ticks;
+    h.compress_moves = sim.compress_moves;
+    h.view = view;
+
+    out.resize(sizeof(h) + sim.puzzles.size() * sizeof(CheckpointBoard));
+    memcpy(&out[0], &h, sizeof(h));
+
+    uint8_t pos[MAX_DISCS];
+    for (size_t k = 0; k < sim.puzzles.size(); k++)
+    {
+        Puzzle const& p = sim.puzzles[k];
+        CheckpointBoard b;
+        memset(&b, 0, sizeof(b));
+        b.moves = p.sol.position();
+        b.start_delay = p.start_delay;
+        b.to_solve = p.to_solve;
+
+        board_positions(p, pos);
+        for (size_t i = 0; i < p.num_discs; i++)
+            b.state[i / 32] |= (uint64_t)pos[i] << (2 * (i % 32));
+        b.swapped = swapped_pairs(p);
+
+        b.flights = min(p.active_discs.size(), PIPELINE_DEPTH);
+        for (size_t a = 0; a < b.flights; a++)
+        {
+            ActiveDisc const& ad = p.active_discs[a];
+            CheckpointFlight& f = b.flight[a];
+            f.disc = ad.disc_index;
+            f.from_axis = ad.from_axis;
+            f.to_axis = ad.to_axis;
+            f.phase = ad.phase;
+            f.from_height = lround(ad.start_pos.z / p.board.disc_height) - 1;   // positions[h].z = (h + 1) * disc_height
+            f.u = ad.u;
+            f.z = sim.discs.pz[p.disc_base + ad.disc_index];
+        }
+        memcpy(&out[sizeof(h) + k * sizeof(b)], &b, sizeof(b));
+    }
+}
+
+bool checkpoint_load(const char* path, Checkpoint& c)
+{
+    FILE* file = fopen(path, "rb");
+    if (!file)
+        return false;
+
+    CheckpointHeader& h = c.header;
+    bool ok = fread(&h, sizeof(h), 1, file) == 1 &&
+              memcmp(h.magic, CHECKPOINT_MAGIC, sizeof(h.magic)) == 0 &&
+              h.version == CHECKPOINT_VERSION && h.board_size == sizeof(CheckpointBoard) &&
+              h.grid_cols > 0 && h.grid_rows > 0 && h.min_discs > 0 &&
+              h.variant < V_COUNT && h.min_discs <= h.max_discs &&
+              h.max_discs <= variant_max_discs(h.variant) && h.pipeline_depth > 0 && h.view.fps > 0;
+    if (ok) {
+        c.boards.resize((size_t)h.grid_cols * h.grid_rows);
+        ok = fread(c.boards.data(), sizeof(CheckpointBoard), c.boards.size(), file) == c.boards.size();
+    }
+    fclose(file);
+    if (!ok)
+        return false;
+
+    //Every board must be a legal state of its disc count
+    size_t span = h.max_discs - h.min_discs + 1;
+    for (size_t k = 0; k < c.boards.size(); k++)
+    {
+        CheckpointBoard const& b = c.boards[k];
+        size_t n = h.min_discs + k % span;
+        if (b.flights > PIPELINE_DEPTH || b.moves > variant_moves(h.variant, n))
+            return false;
+        for (size_t i = 0; i < n; i++)
+            if (((b.state[i / 32] >> (2 * (i % 32))) & 3) > 2)
+                return false;
+        for (size_t a = 0; a < b.flights; a++)
+        {
+            CheckpointFlight const& f = b.flight[a];
+            if (f.disc >= n || f.from_axis > 2 || f.to_axis > 2 || f.from_axis == f.to_axis ||
+                f.phase > PHASE_DROP || f.from_height >= n)
+                return false;
+        }
+    }
+    return true;
+}
+
+void checkpoint_configure(Simulation& sim, Checkpoint const& c)
+{
+    sim.grid_cols = c.header.grid_cols;
+    sim.grid_rows = c.header.grid_rows;
+    sim.grid_min_discs = c.header.min_discs;
+    sim.grid_max_discs = c.header.max_discs;
+    sim.pipeline_depth = c.header.pipeline_depth;
+    sim.variant = c.header.variant;
+    sim.compress_moves = c.header.compress_moves;
+    sim.FPS = c.header.view.fps;
+}
+
+//Puts a disc back in flight where it was: its board slot is already taken at the destination
+static void restore_flight(Simulation& sim, Puzzle& p, CheckpointFlight const& f)
+{
+    GameBoard const& t_board = p.board;
+    ActiveDisc ad;
+    ad.disc_index = f.disc;
+    ad.from_axis = f.from_axis;
+    ad.to_axis = f.to_axis;
+    ad.direction = (f.to_axis > f.from_axis) ? 1 : -1;
+    ad.phase = f.phase;
+    ad.u = f.u;
+    ad.step_u = 0.025;
+    ad.start_pos = t_board.axis[f.from_axis].positions[f.from_height];
+
+    vector<int> const& occ = t_board.axis[f.to_axis].occupancy_val;
+    size_t h = 0;
+    while (h < p.num_discs && occ[h] != f.disc) h++;
+    ad.dest_pos = t_board.axis[f.to_axis].positions[h];
+
+    size_t s = p.disc_base + f.disc;
+    CustomPoint pos = (f.phase == PHASE_DROP) ? ad.dest_pos : ad.start_pos;
+    sim.discs.nx[s] = 0.0f;
+    sim.discs.ny[s] = 0.0f;
+    sim.discs.nz[s] = 1.0f;
+    if (f.phase == PHASE_FLIGHT) {
+        CustomPoint prev = get_inerpolated_coordinate(t_board, ad.start_pos, ad.dest_pos, max(0.0, ad.u - ad.step_u));
+        pos = get_inerpolated_coordinate(t_board, ad.start_pos, ad.dest_pos, ad.u);
+        set_normal(sim.discs, s, pos.x - prev.x, pos.y - prev.y, pos.z - prev.z);
+    }
+    sim.discs.px[s] = pos.x;
+    sim.discs.py[s] = pos.y;
+    sim.discs.pz[s] = (f.phase == PHASE_FLIGHT) ? pos.z : f.z;
+    p.active_discs.push_back(ad);
+}
+
+void checkpoint_apply(Simulation& sim, Checkpoint const& c)
+{
+    uint8_t pos[MAX_DISCS];
+    for (size_t k = 0; k < sim.puzzles.size() && k < c.boards.size(); k++)
+    {
+        Puzzle& p = sim.puzzles[k];
+        CheckpointBoard const& b = c.boards[k];
+        for (size_t i = 0; i < p.num_discs; i++)
+            pos[i] = (b.state[i / 32] >> (2 * (i % 32))) & 3;
+        set_puzzle_state(sim, p, pos, b.swapped);
+
+        for (size_t a = 0; a < b.flights; a++)
+            restore_flight(sim, p, b.flight[a]);
+
+        p.start_delay = b.start_delay;
+        p.to_solve = b.to_solve;
+        if (p.to_solve) {
+            SolutionGrammar::symbol root = variant_stack(sim.solutions, p.variant, p.num_discs);
+            p.sol = SolutionCursor(&sim.solutions, root, b.moves);
+            p.to_solve = !p.sol.empty();
+        }
+    }
+    sim.ticks = c.header.ticks;
+}
+
+CheckpointWriter::CheckpointWriter() : has_pending(false), quit(false), running(false)
+{
+}
+
+CheckpointWriter::~CheckpointWriter()
+{
+    stop();
+}
+
+void CheckpointWriter::start(const char* file)
+{
+    stop();
+    path = file;
+    quit = false;
+    running = true;
+    worker = thread(&CheckpointWriter::run, this);
+}
+
+void CheckpointWriter::submit(string& blob)
+{
+    {
+        lock_guard<mutex> guard(lock);
+        pending.swap(blob);
+        has_pending = true;
+    }
+    wake.notify_one();
+}
+
+void CheckpointWriter::stop()
+{
+    if (!running)
+        return;
+    {
+        lock_guard<mutex> guard(lock);
+        quit = true;
+    }
+    wake.notify_one();
+    worker.join();
+    running = false;
+}
+
+void CheckpointWriter::run()
+{
+    string tmp = path + ".tmp";
+    string blob;
+    for (;;)
+    {
+        {
+            unique_lock<mutex> guard(lock);
+            while (!has_pending && !quit)
+                wake.wait(guard);
+            if (!has_pending)
+                return;
+            blob.swap(pending);
+            has_pending = false;
+        }
+
+        //Written in full and synced before the rename, so a crash leaves the old or the new checkpoint
+        int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0)
+            continue;
+        bool ok = true;
+        for (size_t done = 0; ok && done < blob.size();)
+        {
+            ssize_t w = write(fd, blob.data() + done, blob.size() - done);
+            ok = w > 0;
+            if (ok) done += w;
+        }
+        ok = ok && fsync(fd) == 0;
+        close(fd);
+        if (!ok || rename(tmp.c_str(), path.c_str()) != 0)
+            unlink(tmp.c_str());
+    }
+}
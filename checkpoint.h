@@ -0,0 +1,99 @@
+#ifndef HANOI_CHECKPOINT_H
+#define HANOI_CHECKPOINT_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "simulation.h"
+
+// Checkpoint of a running scene: a header with the scene configuration and
+// the view, then one fixed record per board. A board is restored from its
+// state (axis of every disc, packed like the query service does, and the order
+// of the discs of a size in a double tower) and the few discs in flight,
+// without replaying any move; the solver resumes at its move counter through
+// the closed form of the grammar cursor.
+struct CheckpointView {
+    float angle, angle2;             // Camera
+    float light_angle, light_height;
+    float fov;
+    uint8_t light_auto_move, directional_light;
+    uint16_t fps;
+};
+
+struct CheckpointFlight {
+    uint8_t disc, from_axis, to_axis, phase;
+    uint8_t from_height;             // Slot the disc left on its source axis
+    uint8_t reserved[3];
+    double u;                        // Kept exact, the landing tick depends on it
+    float z;
+    uint32_t reserved2;
+};
+
+struct CheckpointBoard {
+    uint64_t moves;                  // Solver moves started
+    uint64_t state[2];               // Axis of disc i in bits 2i..2i+1, the discs in flight at their destination
+    uint32_t start_delay;
+    uint8_t to_solve, flights;
+    uint8_t reserved[2];
+    uint32_t swapped;                // Double tower pairs with disc 2j under disc 2j + 1
+    uint32_t reserved2;
+    CheckpointFlight flight[PIPELINE_DEPTH];
+};
+
+struct CheckpointHeader {
+    char magic[4];                   // "HCKP"
+    uint16_t version;
+    uint16_t board_size;
+    uint16_t grid_cols, grid_rows;
+    uint8_t min_discs, max_discs;
+    uint8_t pipeline_depth;
+    uint8_t variant;                 // HANOI_VARIANT, 0 (classic) in files written before variants
+    uint8_t reserved[2];
+    uint64_t ticks;
+    uint64_t compress_moves;         // Simulation::compress_moves
+    CheckpointView view;
+};
+
+struct Checkpoint {
+    CheckpointHeader header;
+    std::vector<CheckpointBoard> boards;
+};
+
+// Serializes the simulation and the view into out
+void checkpoint_capture(Simulation const& sim, CheckpointView const& view, std::string& out);
+// Reads and validates a checkpoint file, false if it is missing or malformed
+bool checkpoint_load(const char* path, Checkpoint& c);
+// Sets the grid configuration of sim to the checkpoint's, before initialize_simulation
+void checkpoint_configure(Simulation& sim, Checkpoint const& c);
+// Restores every board of a simulation laid out by checkpoint_configure
+void checkpoint_apply(Simulation& sim, Checkpoint const& c);
+
+// Writes checkpoints on its own thread: submit only hands the buffer over, the
+// newest one wins, and the file is replaced atomically by writing a temporary
+// file, syncing it and renaming it over the old one.
+class CheckpointWriter {
+public:
+    CheckpointWriter();
+    ~CheckpointWriter();
+
+    void start(const char* path);
+    bool is_open() const { return running; }
+    void submit(std::string& blob);  // Takes the contents of blob
+    void stop();                     // Writes what is pending and joins
+
+private:
+    std::string path;
+    std::thread worker;
+    std::mutex lock;
+    std::condition_variable wake;
+    std::string pending;
+    bool has_pending, quit, running;
+
+    void run();
+};
+
+#endif
@@ -0,0 +1,639 @@
+#include "fourpeg.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+
+using namespace std;
+
+static const char PDB_MAGIC[4] = { 'H', 'P', 'D', 'B' };
+static const uint16_t PDB_VERSION = 2;
+static const uint8_t PDB_UNSEEN = 3;         // Two-bit entry of a placement the search has not reached
+static const uint8_t PDB_UNKNOWN = 0xff;
+
+struct PdbFileHeader {
+    char magic[4];                   // "HPDB"
+    uint16_t version;
+    uint8_t discs;
+    uint8_t reserved;
+    uint32_t goal;                   // Canonical goal placement
+    uint32_t reserved2;
+    uint64_t entries;                // 4^discs distances mod 3 follow, four per byte
+};
+
+static uint64_t pdb_bytes(int discs)
+{
+    return (((uint64_t)1 << (2 * discs)) + 3) / 4;
+}
+
+//Top disc of every peg of a placement of k discs, -1 for an empty peg
+static void peg_tops(uint64_t s, int k, int top[4])
+{
+    top[0] = top[1] = top[2] = top[3] = -1;
+    for (int i = k - 1; i >= 0; i--)
+        top[(s >> (2 * i)) & 3] = i;
+}
+
+static inline uint64_t with_peg(uint64_t s, int disc, int peg)
+{
+    return (s & ~((uint64_t)3 << (2 * disc))) | ((uint64_t)peg << (2 * disc));
+}
+
+//One level of the breadth-first search: the placements of frontier words
+//[begin, end) give the unseen ones next to them distance d + 1 and the next frontier
+static void pdb_level(uint8_t* table, int k, uint8_t d, const uint64_t* frontier, uint64_t* next,
+                      uint64_t begin, uint64_t end, char* grew)
+{
+    bool any = false;
+    uint8_t code = (d + 1) % 3;
+    for (uint64_t w = begin; w < end; w++)
+    {
+        for (uint64_t bits = frontier[w]; bits != 0; bits &= bits - 1)
+        {
+            uint64_t x = w * 64 + __builtin_ctzll(bits);
+            int top[4];
+            peg_tops(x, k, top);
+            for (int f = 0; f < 4; f++)
+            {
+                if (top[f] < 0) continue;
+                for (int t = 0; t < 4; t++)
+                {
+                    if (t == f || (top[t] >= 0 && top[t] < top[f])) continue;
+                    uint64_t y = with_peg(x, top[f], t);
+                    int shift = 2 * (y & 3);
+                    if ((__atomic_load_n(&table[y >> 2], __ATOMIC_RELAXED) >> shift & 3) != PDB_UNSEEN)
+                        continue;
+                    //Clearing bits of an unseen entry writes code, so of the threads that reach y
+                    //only the first one sees it unseen and adds it to the next frontier
+                    uint8_t clear = (uint8_t)((PDB_UNSEEN & ~code) << shift);
+                    if ((__atomic_fetch_and(&table[y >> 2], (uint8_t)~clear, __ATOMIC_RELAXED) >> shift & 3) == PDB_UNSEEN) {
+                        __atomic_fetch_or(&next[y / 64], (uint64_t)1 << (y % 64), __ATOMIC_RELAXED);
+                        any = true;
+                    }
+                }
+            }
+        }
+    }
+    *grew = any;
+}
+
+static bool build_pdb(uint8_t* table, int k, uint32_t goal, unsigned threads)
+{
+    uint64_t entries = (uint64_t)1 << (2 * k);
+    uint64_t words = (entries + 63) / 64;
+    memset(table, 0xff, pdb_bytes(k));
+    table[goal >> 2] &= ~(PDB_UNSEEN << (2 * (goal & 3)));
+
+    //One bit per placement for the current and the next level
+    vector<uint64_t> frontier(words, 0), next(words, 0);
+    frontier[goal / 64] = (uint64_t)1 << (goal % 64);
+
+    threads = max(1u, min<unsigned>(threads, words / 64 + 1));
+    vector<thread> pool(threads);
+    vector<char> grew(threads);
+    for (int d = 0; ; d++)
+    {
+        //Exact distances are carried in a byte by the search
+        if (d == 0xff)
+            return false;
+        uint64_t chunk = (words + threads - 1) / threads;
+        for (unsigned i = 0; i < threads; i++)
+            pool[i] = thread(pdb_level, table, k, (uint8_t)d, frontier.data(), next.data(),
+                             min(words, i * chunk), min(words, (i + 1) * chunk), &grew[i]);
+        bool any = false;
+        for (unsigned i = 0; i < threads; i++)
+        {
+            pool[i].join();
+            any |= grew[i];
+        }
+        if (!any)
+            return true;
+        frontier.swap(next);
+        fill(next.begin(), next.end(), 0);
+    }
+}
+
+PatternDatabase::PatternDatabase() : base(NULL), length(0), table(NULL), discs(0), goal(0), built(false)
+{
+}
+
+PatternDatabase::~PatternDatabase()
+{
+    close();
+}
+
+static bool map_pdb(const char* path, int discs, uint32_t goal, void*& base, size_t& length)
+{
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    uint64_t entries = (uint64_t)1 << (2 * discs);
+    if (fstat(fd, &st) != 0 || (uint64_t)st.st_size != sizeof(PdbFileHeader) + pdb_bytes(discs)) {
+        ::close(fd);
+        return false;
+    }
+    void* m = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (m == MAP_FAILED)
+        return false;
+
+    PdbFileHeader const* h = (PdbFileHeader const*)m;
+    if (memcmp(h->magic, PDB_MAGIC, sizeof(h->magic)) != 0 || h->version != PDB_VERSION ||
+        h->discs != discs || h->goal != goal || h->entries != entries) {
+        munmap(m, st.st_size);
+        return false;
+    }
+    base = m;
+    length = st.st_size;
+    return true;
+}
+
+bool PatternDatabase::open(const char* path, int discs, uint32_t goal, unsigned threads)
+{
+    close();
+    if (discs < 1 || discs > PDB_MAX_DISCS || ((uint64_t)goal >> (2 * discs)) != 0)
+        return false;
+
+    if (!map_pdb(path, discs, goal, base, length)) {
+        //Built in a mapping of a temporary file, renamed once complete
+        string tmp = string(path) + ".tmp";
+        uint64_t entries = (uint64_t)1 << (2 * discs);
+        size_t size = sizeof(PdbFileHeader) + pdb_bytes(discs);
+        int fd = ::open(tmp.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0)
+            return false;
+        void* m = (ftruncate(fd, size) == 0) ? mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+        bool ok = m != MAP_FAILED;
+        if (ok) {
+            PdbFileHeader h;
+            memset(&h, 0, sizeof(h));
+            memcpy(h.magic, PDB_MAGIC, sizeof(h.magic));
+            h.version = PDB_VERSION;
+            h.discs = discs;
+            h.goal = goal;
+            h.entries = entries;
+            memcpy(m, &h, sizeof(h));
+            ok = build_pdb((uint8_t*)m + sizeof(h), discs, goal, threads) && msync(m, size, MS_SYNC) == 0;
+            munmap(m, size);
+        }
+        ok = ok && fsync(fd) == 0;
+        ::close(fd);
+        if (!ok || rename(tmp.c_str(), path) != 0 || !map_pdb(path, discs, goal, base, length)) {
+            unlink(tmp.c_str());
+            return false;
+        }
+        built = true;
+    }
+    table = (const uint8_t*)base + sizeof(PdbFileHeader);
+    this->discs = discs;
+    this->goal = goal;
+
+    //Small databases are read at every state, a byte each spares following the residues
+    if (discs <= PDB_EXACT_DISCS) {
+        vector<uint8_t> exact((uint64_t)1 << (2 * discs), PDB_UNKNOWN);
+        vector<uint32_t> chain;
+        exact[goal] = 0;
+        for (uint32_t p = 0; p < exact.size(); p++)
+        {
+            for (uint32_t q = p; exact[q] == PDB_UNKNOWN; q = closer(q))
+                chain.push_back(q);
+            for (; !chain.empty(); chain.pop_back())
+                exact[chain.back()] = exact[closer(chain.back())] + 1;
+        }
+        bytes.swap(exact);
+    }
+    return true;
+}
+
+uint32_t PatternDatabase::closer(uint32_t placement) const
+{
+    uint8_t r = (residue(placement) + 2) % 3;
+    int top[4];
+    peg_tops(placement, discs, top);
+    for (int f = 0; f < 4; f++)
+    {
+        if (top[f] < 0) continue;
+        for (int t = 0; t < 4; t++)
+        {
+            if (t == f || (top[t] >= 0 && top[t] < top[f])) continue;
+            uint32_t y = with_peg(placement, top[f], t);
+            if (residue(y) == r)
+                return y;
+        }
+    }
+    return placement;     // The goal
+}
+
+uint8_t PatternDatabase::distance(uint32_t placement) const
+{
+    if (!bytes.empty())
+        return bytes[placement];
+    uint8_t d = 0;
+    for (; placement != goal; placement = closer(placement))
+        d++;
+    return d;
+}
+
+void PatternDatabase::close()
+{
+    if (base)
+        munmap(base, length);
+    base = NULL;
+    length = 0;
+    table = NULL;
+    vector<uint8_t>().swap(bytes);
+    built = false;
+}
+
+PatternStore::PatternStore(string const& directory, int group_discs, unsigned threads)
+    : directory(directory), group(max(1, min(PDB_MAX_DISCS, group_discs))), threads(threads)
+{
+}
+
+PatternStore::~PatternStore()
+{
+    for (map<pair<int, uint32_t>, PatternDatabase*>::iterator it = databases.begin(); it != databases.end(); ++it)
+        delete it->second;
+}
+
+PatternDatabase const* PatternStore::get(int discs, uint32_t canonical_goal)
+{
+    pair<int, uint32_t> key(discs, canonical_goal);
+    map<pair<int, uint32_t>, PatternDatabase*>::iterator it = databases.find(key);
+    if (it != databases.end())
+        return it->second;
+
+    char name[64];
+    snprintf(name, sizeof(name), "/hanoi_pdb_%d_%06x.bin", discs, canonical_goal);
+    PatternDatabase* db = new PatternDatabase();
+    if (!db->open((directory + name).c_str(), discs, canonical_goal, threads)) {
+        delete db;
+        return NULL;
+    }
+    databases[key] = db;
+    return db;
+}
+
+size_t PatternStore::built_count() const
+{
+    size_t n = 0;
+    for (map<pair<int, uint32_t>, PatternDatabase*>::const_iterator it = databases.begin(); it != databases.end(); ++it)
+        n += it->second->was_built();
+    return n;
+}
+
+// Discs lo .. lo + k - 1 looked up in one database, with the pegs relabelled
+// four discs at a time through a byte table
+struct PatternGroup {
+    int lo, k;
+    uint32_t mask;
+    uint8_t relabel[256];
+    PatternDatabase const* db;
+    int carried;       // Index of its distance in every node's array, -1 when the database is exact
+
+    uint32_t placement(PegState s) const
+    {
+        uint32_t x = (s >> (2 * lo)) & mask;
+        uint32_t y = relabel[x & 0xff] | (relabel[(x >> 8) & 0xff] << 8) |
+                     (relabel[(x >> 16) & 0xff] << 16) | ((uint32_t)relabel[x >> 24] << 24);
+        return y & mask;
+    }
+    bool has(int disc) const { return disc >= lo && disc < lo + k; }
+};
+
+static bool make_group(PatternStore& store, int lo, int k, PegState goal, PatternGroup& g)
+{
+    g.lo = lo;
+    g.k = k;
+    g.mask = (uint32_t)(((uint64_t)1 << (2 * k)) - 1);
+
+    //Pegs numbered in order of first use from the group's largest disc
+    int label[4] = { -1, -1, -1, -1 };
+    int next = 0;
+    for (int i = k - 1; i >= 0; i--)
+    {
+        int p = (goal >> (2 * (lo + i))) & 3;
+        if (label[p] < 0) label[p] = next++;
+    }
+    for (int p = 0; p < 4; p++)
+        if (label[p] < 0) label[p] = next++;
+
+    for (int b = 0; b < 256; b++)
+    {
+        g.relabel[b] = 0;
+        for (int f = 0; f < 4; f++)
+            g.relabel[b] |= label[(b >> (2 * f)) & 3] << (2 * f);
+    }
+    uint32_t canonical = 0;
+    for (int i = 0; i < k; i++)
+        canonical |= (uint32_t)label[(goal >> (2 * (lo + i))) & 3] << (2 * i);
+
+    g.db = store.get(k, canonical);
+    return g.db != NULL;
+}
+
+static void three_peg(int k, int a, int b, int via, vector<solution_pair>& out)
+{
+    if (k == 0)
+        return;
+    three_peg(k - 1, a, via, b, out);
+    solution_pair m;
+    m.f = a;
+    m.t = b;
+    out.push_back(m);
+    three_peg(k - 1, via, b, a, out);
+}
+
+//Frame-Stewart: the split[k] smallest discs aside over four pegs, the others
+//across over the remaining three, then the smallest back on top of them
+static void frame_stewart(int k, int a, int b, int c, int d, int const* split, vector<solution_pair>& out)
+{
+    if (k == 0)
+        return;
+    int m = split[k];
+    frame_stewart(m, a, c, b, d, split, out);
+    three_peg(k - m, a, b, d, out);
+    frame_stewart(m, c, b, a, d, split, out);
+}
+
+// A* node: state in bits 0..47, the move that reached it in 48..51, closed
+// flag in bit 52 and g in 53..63
+const uint64_t NODE_EMPTY = ~(uint64_t)0;
+const uint64_t NODE_STATE = ((uint64_t)1 << 48) - 1;
+const int NODE_MOVE = 48, NODE_CLOSED = 52, NODE_G = 53;
+
+static inline uint64_t node_g(uint64_t e) { return e >> NODE_G; }
+
+//Every disc of the n on one peg, the peg in *peg
+static bool is_tower(int n, PegState s, int* peg)
+{
+    PegState ones = (((uint64_t)1 << (2 * n)) - 1) / 3;
+    *peg = s & 3;
+    return s == ones * *peg;
+}
+
+FOURPEG_STATUS fourpeg_solve(PatternStore& store, int n, PegState start, PegState goal,
+                             size_t max_nodes, FourPegResult& out)
+{
+    out.moves.clear();
+    out.expanded = out.stored = 0;
+    if (n < 1 || n > FOURPEG_MAX_DISCS)
+        return FP_INVALID;
+    PegState all = ((uint64_t)1 << (2 * n)) - 1;
+    start &= all;
+    goal &= all;
+    //A largest disc already on its goal peg never has to move
+    while (n > 1 && (start >> (2 * n - 2)) == (goal >> (2 * n - 2)))
+    {
+        n--;
+        start &= ~((uint64_t)3 << (2 * n));
+        goal &= ~((uint64_t)3 << (2 * n));
+    }
+    //From one tower to another, Frame-Stewart's moves are optimal (Bousch, 2014)
+    int a, b;
+    if (is_tower(n, start, &a) && is_tower(n, goal, &b) && a != b) {
+        int split[FOURPEG_MAX_DISCS + 1];
+        uint64_t length[FOURPEG_MAX_DISCS + 1];
+        length[0] = 0;
+        for (int k = 1; k <= n; k++)
+        {
+            length[k] = ~(uint64_t)0;
+            for (int m = 0; m < k; m++)
+                if (2 * length[m] + ((uint64_t)1 << (k - m)) - 1 < length[k]) {
+                    length[k] = 2 * length[m] + ((uint64_t)1 << (k - m)) - 1;
+                    split[k] = m;
+                }
+        }
+        int c = (a + 1) % 4 == b ? (a + 2) % 4 : (a + 1) % 4;
+        frame_stewart(n, a, b, c, 6 - a - b - c, split, out.moves);
+        return FP_SOLVED;
+    }
+
+    int group = store.group_discs();
+
+    //One split per placement of the full databases: the first group takes the
+    //smallest first discs (first = 0 meaning a full group), the others are full
+    //but for the last one. Each is a lower bound, the largest is used. A group
+    //shared by several splits is looked up once
+    int rest = (n > group) ? n % group : 0;
+    vector<PatternGroup> groups;
+    vector<vector<int> > split(rest + 1);
+    int carried = 0;
+    for (int first = 0; first <= rest; first++)
+    {
+        for (int lo = 0; lo < n; )
+        {
+            int k = (lo == 0 && first > 0) ? first : min(group, n - lo);
+            size_t j = 0;
+            while (j < groups.size() && (groups[j].lo != lo || groups[j].k != k))
+                j++;
+            if (j == groups.size()) {
+                PatternGroup g;
+                if (!make_group(store, lo, k, goal, g))
+                    return FP_NO_DATABASE;
+                g.carried = g.db->exact() ? -1 : carried++;
+                groups.push_back(g);
+            }
+            split[first].push_back(j);
+            lo += k;
+        }
+    }
+
+    //The large databases only give distances mod 3, so every stored state
+    //carries its exact distance for each of them: a child's follows from its
+    //parent's, unchanged unless the moved disc belongs to the group
+    vector<uint8_t> distance(groups.size());
+    auto heuristic = [&](PegState s, const uint8_t* known) {
+        for (size_t j = 0; j < groups.size(); j++)
+            distance[j] = groups[j].carried >= 0 ? known[groups[j].carried]
+                                                 : groups[j].db->distance(groups[j].placement(s));
+        uint64_t best = 0;
+        for (size_t i = 0; i < split.size(); i++)
+        {
+            uint64_t h = 0;
+            for (size_t j = 0; j < split[i].size(); j++)
+                h += distance[split[i][j]];
+            best = max(best, h);
+        }
+        return best;
+    };
+    auto child_known = [&](PegState c, int disc, const uint8_t* known, uint8_t* out) {
+        for (size_t j = 0; j < groups.size(); j++)
+        {
+            int i = groups[j].carried;
+            if (i >= 0)
+                out[i] = groups[j].has(disc) ? groups[j].db->next_distance(groups[j].placement(c), known[i]) : known[i];
+        }
+    };
+
+    //Open addressing table of every state seen, buckets of open states by f
+    size_t capacity = 1024;
+    while (capacity < 2 * max_nodes)
+        capacity *= 2;
+    vector<uint64_t> nodes(capacity, NODE_EMPTY);
+    vector<uint8_t> known(capacity * carried);
+    auto slot = [&](PegState s) {
+        size_t i = (s * 0x9E3779B97F4A7C15ull) >> 20 & (capacity - 1);
+        while (nodes[i] != NODE_EMPTY && (nodes[i] & NODE_STATE) != s)
+            i = (i + 1) & (capacity - 1);
+        return i;
+    };
+    vector<vector<uint64_t> > open;
+    auto push = [&](PegState s, uint64_t g, uint64_t f) {
+        if (open.size() <= f) open.resize(f + 1);
+        open[f].push_back(s | g << 48);
+    };
+
+    size_t root = slot(start);
+    nodes[root] = start;
+    for (size_t j = 0; j < groups.size(); j++)
+        if (groups[j].carried >= 0)
+            known[root * carried + groups[j].carried] = groups[j].db->distance(groups[j].placement(start));
+    out.stored = 1;
+    push(start, 0, heuristic(start, known.data() + root * carried));
+    for (size_t f = 0; f < open.size(); f++)
+    {
+        //Last in, first out within an f: the deepest states first
+        while (!open[f].empty())
+        {
+            uint64_t entry = open[f].back();
+            open[f].pop_back();
+            PegState s = entry & NODE_STATE;
+            uint64_t g = entry >> 48;
+            size_t at = slot(s);
+            uint64_t& node = nodes[at];
+            if ((node >> NODE_CLOSED & 1) || node_g(node) < g)
+                continue;
+            node |= (uint64_t)1 << NODE_CLOSED;
+            out.expanded++;
+
+            int top[4];
+            peg_tops(s, n, top);
+            if (s == goal) {
+                //Back from the goal: the disc on top of a move's destination is the one it moved
+                while (s != start)
+                {
+                    uint64_t e = nodes[slot(s)];
+                    solution_pair m;
+                    m.f = e >> (NODE_MOVE + 2) & 3;
+                    m.t = e >> NODE_MOVE & 3;
+                    out.moves.push_back(m);
+                    peg_tops(s, n, top);
+                    s = with_peg(s, top[m.t], m.f);
+                }
+                reverse(out.moves.begin(), out.moves.end());
+                return FP_SOLVED;
+            }
+
+            //Moving the same disc twice in a row is never optimal
+            int last = -1;
+            if (s != start)
+                last = top[node >> NODE_MOVE & 3];
+            for (int a = 0; a < 4; a++)
+            {
+                if (top[a] < 0 || top[a] == last) continue;
+                for (int b = 0; b < 4; b++)
+                {
+                    if (b == a || (top[b] >= 0 && top[b] < top[a])) continue;
+                    PegState c = with_peg(s, top[a], b);
+                    size_t to = slot(c);
+                    uint64_t& child = nodes[to];
+                    if (child != NODE_EMPTY && ((child >> NODE_CLOSED & 1) || node_g(child) <= g + 1))
+                        continue;
+                    if (child == NODE_EMPTY && ++out.stored > max_nodes)
+                        return FP_NODE_LIMIT;
+                    child = c | (uint64_t)(a << 2 | b) << NODE_MOVE | (g + 1) << NODE_G;
+                    child_known(c, top[a], known.data() + at * carried, known.data() + to * carried);
+                    push(c, g + 1, g + 1 + heuristic(c, known.data() + to * carried));
+                }
+            }
+        }
+        vector<uint64_t>().swap(open[f]);
+    }
+    return FP_INVALID;     // Not reached, every placement leads to every other
+}
+
+static bool parse_state(const char* text, int n, PegState& s)
+{
+    if ((int)strlen(text) != n)
+        return false;
+    s = 0;
+    for (int i = 0; i < n; i++)
+    {
+        if (text[i] < '0' || text[i] > '3')
+            return false;
+        s |= (PegState)(text[i] - '0') << (2 * i);
+    }
+    return true;
+}
+
+int fourpeg_main(int argc, char** argv)
+{
+    int n = 0;
+    const char* from = NULL;
+    const char* to = NULL;
+    string dir = ".";
+    int group = PDB_DEFAULT_DISCS;
+    int threads = max(1u, thread::hardware_concurrency());
+    size_t max_nodes = (size_t)1 << 24;
+    bool print = false;
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+        if (arg == "--four-peg" && i + 1 < argc) n = atoi(argv[++i]);
+        else if (arg == "--from" && i + 1 < argc) from = argv[++i];
+        else if (arg == "--to" && i + 1 < argc) to = argv[++i];
+        else if (arg == "--pdb-dir" && i + 1 < argc) dir = argv[++i];
+        else if (arg == "--pdb-discs" && i + 1 < argc) group = atoi(argv[++i]);
+        else if (arg == "--threads" && i + 1 < argc) threads = atoi(argv[++i]);
+        else if (arg == "--max-nodes" && i + 1 < argc) max_nodes = strtoull(argv[++i], NULL, 10);
+        else if (arg == "--print") print = true;
+    }
+
+    PegState start = 0, goal = 0;
+    if (n >= 1 && n <= FOURPEG_MAX_DISCS && !to)
+        goal = ((uint64_t)1 << (2 * n)) - 1;     // Every disc on peg 3
+    if (n < 1 || n > FOURPEG_MAX_DISCS || group < 1 || group > PDB_MAX_DISCS || threads < 1 || (from && !parse_state(from, n, start)) || (to && !parse_state(to, n, goal))) {
+        cerr << "Uso: hanoi --four-peg N [--from S] [--to S] [--pdb-dir D] [--pdb-discs K] [--threads T] [--max-nodes M] [--print]" << endl;
+        cerr << "1 <= N <= " << FOURPEG_MAX_DISCS << ", 1 <= K <= " << PDB_MAX_DISCS << ", T >= 1, S = um digito 0..3 por disco, o menor primeiro" << endl;
+        cerr << "De torre a torre ate " << FOURPEG_MAX_DISCS << " discos; entre estados quaisquer, ate cerca de "
+             << FOURPEG_SEARCH_DISCS << " discos (alguns pedem --max-nodes 67108864)" << endl;
+        return 1;
+    }
+    int a, b;
+    if (n > FOURPEG_SEARCH_DISCS && !(is_tower(n, start, &a) && is_tower(n, goal, &b) && a != b))
+        cerr << "Aviso: acima de " << FOURPEG_SEARCH_DISCS << " discos a busca entre estados quaisquer "
+             << "costuma atingir --max-nodes " << max_nodes << endl;
+
+    chrono::steady_clock::time_point begin = chrono::steady_clock::now();
+    PatternStore store(dir, group, threads);
+    FourPegResult r;
+    FOURPEG_STATUS status = fourpeg_solve(store, n, start, goal, max_nodes, r);
+    double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - begin).count();
+
+    cerr << "Bancos de padroes: " << store.open_count() << " abertos, " << store.built_count() << " gerados em " << dir << endl;
+    cerr << "Estados: " << r.expanded << " expandidos, " << r.stored << " guardados, " << ms << " ms" << endl;
+    if (status == FP_NODE_LIMIT) {
+        cerr << "Erro: limite de " << max_nodes << " estados (--max-nodes) atingido antes de provar uma solucao otima. "
+             << "Aumente --max-nodes (cerca de 32 bytes por estado) ou use menos discos" << endl;
+        return 2;
+    }
+    if (status != FP_SOLVED) {
+        cerr << "Erro: nao foi possivel gerar os bancos de padroes em " << dir << endl;
+        return 1;
+    }
+    cout << "Otimo: " << r.moves.size() << " movimentos" << endl;
+    if (print)
+        for (size_t i = 0; i < r.moves.size(); i++)
+            cout << r.moves[i].f << " " << r.moves[i].t << "\n";
+    return 0;
+}
@@ -0,0 +1,121 @@
+#ifndef HANOI_FOURPEG_H
+#define HANOI_FOURPEG_H
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "solution.h"
+
+// Four-peg solver: provably optimal move sequences between any two states of
+// up to FOURPEG_MAX_DISCS discs on four pegs, where no closed form is known.
+// A* is guided by additive pattern databases: the discs are split into groups
+// of consecutive sizes, and each group's exact distance to its goal, ignoring
+// the other discs, is read from a table over every placement of the group.
+// Moves of disjoint groups are disjoint, so the distances add up; the
+// heuristic is the largest sum over the placements of the full groups.
+//
+// Supported range: from one tower to another, any n up to FOURPEG_MAX_DISCS
+// (Frame-Stewart's moves, no search). Between arbitrary states the search is
+// practical up to about FOURPEG_SEARCH_DISCS discs with the default groups,
+// some instances needing a node limit of 2^26; above it the groups miss most
+// of the interaction between large and small discs and the instances reach
+// the limit. Groups of PDB_MAX_DISCS tighten the bound for a four times
+// larger database.
+
+typedef uint64_t PegState;     // Peg of disc i in bits 2i..2i+1, disc 0 being the smallest
+
+const int FOURPEG_MAX_DISCS = 24;
+const int FOURPEG_SEARCH_DISCS = 17;
+const int PDB_MAX_DISCS = 16;      // 4^16 two-bit entries, 1 GB per database, 2 GB more while it is built
+const int PDB_DEFAULT_DISCS = 15;  // 256 MB per database
+const int PDB_EXACT_DISCS = 10;    // Databases up to this size are also kept as one byte per entry
+
+// Distances of k discs to one goal placement, indexed like a PegState of k
+// discs. Only the distance mod 3 is stored, two bits per placement: a move
+// changes the distance by -1, 0 or 1, so the search follows the exact value
+// from one state to the next. Built by a breadth-first search from the goal,
+// level by level over several threads, straight into a file, which is then
+// mapped read-only: the pages are loaded as the search reads them.
+class PatternDatabase {
+public:
+    PatternDatabase();
+    ~PatternDatabase();
+
+    // Maps the database at path, building it first when it is missing or malformed
+    bool open(const char* path, int discs, uint32_t goal, unsigned threads);
+    uint8_t residue(uint32_t placement) const { return table[placement >> 2] >> (2 * (placement & 3)) & 3; }
+    // Exact distance of a placement one move away from one at distance d
+    uint8_t next_distance(uint32_t placement, uint8_t d) const { return d + (residue(placement) + 4 - d % 3) % 3 - 1; }
+    // Exact distance: read from the byte copy up to PDB_EXACT_DISCS discs, else
+    // counted down to the goal, O(distance)
+    uint8_t distance(uint32_t placement) const;
+    bool exact() const { return !bytes.empty(); }
+    bool was_built() const { return built; }
+    void close();
+
+private:
+    uint32_t closer(uint32_t placement) const;     // A neighbour one move closer to the goal
+
+    void* base;
+    size_t length;
+    const uint8_t* table;
+    int discs;
+    uint32_t goal;
+    std::vector<uint8_t> bytes;
+    bool built;
+};
+
+// Databases of groups of up to group_discs discs, opened on first use, one
+// file per group size and goal placement.
+// The pegs of a goal are relabelled in order of first use from the largest
+// disc, so goals that differ by a peg permutation share a file.
+class PatternStore {
+public:
+    PatternStore(std::string const& directory, int group_discs, unsigned threads);
+    ~PatternStore();
+
+    PatternDatabase const* get(int discs, uint32_t canonical_goal);   // NULL if it cannot be built
+    size_t built_count() const;
+    size_t open_count() const { return databases.size(); }
+    int group_discs() const { return group; }
+
+private:
+    std::string directory;
+    int group;
+    unsigned threads;
+    std::map<std::pair<int, uint32_t>, PatternDatabase*> databases;
+};
+
+enum FOURPEG_STATUS
+{
+    FP_SOLVED,
+    FP_NODE_LIMIT,             // max_nodes states stored before an optimal solution was proven
+    FP_NO_DATABASE,            // A pattern database could not be built or mapped
+    FP_INVALID                 // n out of range
+};
+
+struct FourPegResult {
+    std::vector<solution_pair> moves;
+    uint64_t expanded;         // States expanded by A*
+    uint64_t stored;           // States kept in memory
+};
+
+// Fewest moves from start to goal for n discs, keeping at most max_nodes
+// states (8 bytes each plus one per group above PDB_EXACT_DISCS, twice over for
+// the hash table, and the open lists).
+// From one tower to another the moves are Frame-Stewart's, without a search
+FOURPEG_STATUS fourpeg_solve(PatternStore& store, int n, PegState start, PegState goal,
+                             size_t max_nodes, FourPegResult& out);
+
+// hanoi --four-peg N [--from S] [--to S] [--pdb-dir D] [--pdb-discs K]
+//                    [--threads T] [--max-nodes M] [--print]
+// States are one digit 0..3 per disc, smallest disc first; the default goes
+// from every disc on peg 0 to every disc on peg 3. Exits with 2 when the node
+// limit is reached
+int fourpeg_main(int argc, char** argv);
+
+#endif
@@ -0,0 +1,131 @@
+#include "libhanoi.h"
+#include "solution.h"
+
+using namespace std;
+
+static_assert((int)LIBHANOI_CLASSIC == V_CLASSIC && (int)LIBHANOI_CYCLIC == V_CYCLIC &&
+              (int)LIBHANOI_ADJACENT == V_ADJACENT && (int)LIBHANOI_DOUBLE == V_DOUBLE &&
+              (int)LIBHANOI_BICOLOR == V_BICOLOR,
+              "libhanoi variants must follow HANOI_VARIANT");
+
+// Solutions already built by this thread, every (variant, n) shares one grammar
+struct SolverCache {
+    SolutionGrammar grammar;
+    SolutionGrammar::symbol root[V_COUNT][65];
+    bool built[V_COUNT][65];
+
+    SolverCache()
+    {
+        for (int v = 0; v < V_COUNT; v++)
+            for (int n = 0; n <= 64; n++)
+                built[v][n] = false;
+    }
+};
+
+static bool valid(int variant, int n)
+{
+    return variant >= 0 && variant < V_COUNT && n >= 1 && n <= variant_max_discs(variant);
+}
+
+static SolverCache& solver_cache()
+{
+    static thread_local SolverCache cache;
+    return cache;
+}
+
+static SolutionGrammar::symbol solution_root(SolverCache& c, int variant, int n)
+{
+    if (!c.built[variant][n]) {
+        c.root[variant][n] = variant_stack(c.grammar, variant, n);
+        c.built[variant][n] = true;
+    }
+    return c.root[variant][n];
+}
+
+uint32_t libhanoi_abi_version(void)
+{
+    return LIBHANOI_ABI_VERSION;
+}
+
+int libhanoi_max_discs(int variant)
+{
+    return (variant >= 0 && variant < V_COUNT) ? variant_max_discs(variant) : 0;
+}
+
+uint64_t libhanoi_move_count(int variant, int n)
+{
+    if (!valid(variant, n))
+        return 0;
+    SolverCache& c = solver_cache();
+    return c.grammar.length(solution_root(c, variant, n));
+}
+
+int libhanoi_moves(int variant, int n, uint64_t k0, uint64_t k1, libhanoi_move* out)
+{
+    if (!valid(variant, n) || k0 > k1 || (k1 > k0 && !out))
+        return LIBHANOI_EINVAL;
+    SolverCache& c = solver_cache();
+    SolutionGrammar::symbol root = solution_root(c, variant, n);
+    if (k1 > c.grammar.length(root))
+        return LIBHANOI_ERANGE;
+
+    SolutionCursor cursor(&c.grammar, root, k0);
+    for (uint64_t j = 0; j < k1 - k0; j++, cursor.pop_front())
+    {
+        out[j].from = cursor.front().f;
+        out[j].to = cursor.front().t;
+    }
+    return LIBHANOI_OK;
+}
+
+int libhanoi_states(int n, const uint64_t* k, size_t count, uint8_t* out)
+{
+    if (n < 1 || n > 64 || (count > 0 && (!k || !out)))
+        return LIBHANOI_EINVAL;
+    uint64_t last = (n >= 64) ? ~(uint64_t)0 : ((uint64_t)1 << n) - 1;
+    for (size_t j = 0; j < count; j++)
+        if (k[j] > last)
+            return LIBHANOI_ERANGE;
+    hanoi_states_batch(n, k, count, out);
+    return LIBHANOI_OK;
+}
+
+int libhanoi_validate(int variant, int n, const uint8_t* start,
+                      const libhanoi_move* moves, size_t count,
+                      size_t* legal, uint8_t* end)
+{
+    if (!valid(variant, n) || !legal || (count > 0 && !moves))
+        return LIBHANOI_EINVAL;
+
+    //The axis as stacks of disc indices, filled from the largest disc
+    uint8_t stack[3][64], pos[64];
+    int height[3] = { 0, 0, 0 };
+    for (int i = n - 1; i >= 0; i--)
+    {
+        int a = start ? start[i] : variant_start_axis(variant, i);
+        if (a > 2)
+            return LIBHANOI_EINVAL;
+        pos[i] = a;
+        stack[a][height[a]++] = i;
+    }
+
+    size_t j;
+    for (j = 0; j < count; j++)
+    {
+        int f = moves[j].from, t = moves[j].to;
+        if (f > 2 || t > 2 || !variant_allows(variant, f, t) || height[f] == 0)
+            break;
+        int d = stack[f][height[f] - 1];
+        if (height[t] > 0 && variant_disc_size(variant, stack[t][height[t] - 1]) < variant_disc_size(variant, d))
+            break;
+        height[f]--;
+        stack[t][height[t]++] = d;
+        pos[d] = t;
+    }
+
+    *legal = j;
+    if (end)
+        for (int i = 0; i < n; i++)
+            end[i] = pos[i];
+    return LIBHANOI_OK;
+}
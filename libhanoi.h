@@ -0,0 +1,74 @@
+#ifndef HANOI_LIBHANOI_H
+#define HANOI_LIBHANOI_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Embeddable solver: libhanoi.so (./build_lib.sh), plain C ABI, no GLUT.
+//
+// Every entry point works on caller-provided buffers and a whole batch per
+// call. Nothing is allocated per move. The solutions are cached per thread,
+// so the calls are thread-safe and a new (variant, n) costs O(n) once.
+// A state is one byte per disc, disc 0 being the smallest: the axis (0..2)
+// it is on. Functions return LIBHANOI_OK or a negative LIBHANOI_E* code.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LIBHANOI_API __attribute__((visibility("default")))
+
+#define LIBHANOI_ABI_VERSION 1
+
+enum LIBHANOI_STATUS
+{
+    LIBHANOI_OK = 0,
+    LIBHANOI_EINVAL = -1,      // Unknown variant, disc count out of range or NULL buffer
+    LIBHANOI_ERANGE = -2       // Move index past the end of the solution
+};
+
+// Rules, as HANOI_VARIANT: the solution goes from axis 0 to axis 2, except for
+// bicolor, whose discs start on axis 0 and 1 and are sorted there by colour
+enum LIBHANOI_VARIANT
+{
+    LIBHANOI_CLASSIC,
+    LIBHANOI_CYCLIC,           // Clockwise moves only: 0 -> 1 -> 2 -> 0
+    LIBHANOI_ADJACENT,         // No direct move between axis 0 and 2
+    LIBHANOI_DOUBLE,           // Double tower: discs 2j and 2j + 1 have the same size
+    LIBHANOI_BICOLOR           // Same sizes, disc 2j on axis 0 and 2j + 1 on axis 1, the colour
+                               // of disc i being (i / 2 + i) % 2
+};
+
+typedef struct libhanoi_move {
+    uint8_t from, to;
+} libhanoi_move;
+
+// LIBHANOI_ABI_VERSION of the loaded library
+LIBHANOI_API uint32_t libhanoi_abi_version(void);
+
+// Largest n of a variant (its move count fits in 64 bits), 0 for an unknown variant
+LIBHANOI_API int libhanoi_max_discs(int variant);
+
+// Length of the optimal solution, 0 if variant or n is invalid
+LIBHANOI_API uint64_t libhanoi_move_count(int variant, int n);
+
+// Moves k0 .. k1 - 1 of the optimal solution into out[0 .. k1 - k0 - 1].
+// O(n) to seek to k0, then O(1) amortised per move
+LIBHANOI_API int libhanoi_moves(int variant, int n, uint64_t k0, uint64_t k1, libhanoi_move* out);
+
+// Classic states after k[j] moves, j < count: row j is out[j * n .. j * n + n - 1].
+// Closed form, O(n) per state and vectorised where the CPU allows
+LIBHANOI_API int libhanoi_states(int n, const uint64_t* k, size_t count, uint8_t* out);
+
+// Plays count moves from state start (NULL: the start of the variant) under the
+// rules of a variant, stopping at the first illegal one. *legal gets the
+// number of moves played and end, when not NULL, the state reached
+LIBHANOI_API int libhanoi_validate(int variant, int n, const uint8_t* start,
+                                   const libhanoi_move* moves, size_t count,
+                                   size_t* legal, uint8_t* end);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
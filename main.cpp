@@ -1,9 +1,24 @@
 #include <GL/gl.h>
 #include <GL/glut.h>
 
+#include <algorithm>
 #include <cmath>
 #include <iostream>
-#include <list>
+#include <chrono>
+#include <cstdio>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "analytics.h"
+#include "checkpoint.h"
+#include "fourpeg.h"
+#include "mesh.h"
+#include "server.h"
+#include "session.h"
+#include "simulation.h"
+#include "solution.h"
 
 using namespace std;
 
@@ -20,104 +35,112 @@ enum MENU_TYPE
     M_POSITIONAL,
     M_DIRECTIONAL,
     MENU_FULL_SCREEN,
+    MENU_PIPELINE,
+    MENU_PLAY,
+    MENU_STATS,
+    MENU_VARIANT,
+    MENU_COMPRESS,
     MENU_Exit
 };
 
-class CustomPoint {
-public:
-    double x;
-    double y;
-    double z;
-    CustomPoint()
-    {
-        x = 0.0;
-        y = 0.0;
-        z = 0.0;
-    }
-    CustomPoint(double Set_X, double Set_Y, double Set_Z)
-    {
-        x = Set_X;
-        y = Set_Y;
-        z = Set_Z;
-    }
-    CustomPoint& operator= (CustomPoint const& obj)
-    {
-        x = obj.x;
-        y = obj.y;
-        z = obj.z;
-        return *this;
-    }
-    CustomPoint operator-(CustomPoint const& p1)
-    {
-        return CustomPoint(x - p1.x, y - p1.y, z - p1.z);
-    }
-};
-
-class Disk {
-public:
-    Disk()
-    {
-        normal = CustomPoint(0.0, 0.0, 1.0);
-    }
-    CustomPoint position; //
-    CustomPoint normal;   //orientation
-};
-
-struct ActiveDisc {    //Active Disc to be moved [later in motion]
-    int disc_index;
-    CustomPoint start_pos, dest_pos;
-    double u;		    // u E [0, 1]
-    double step_u;
-    bool is_in_motion;
-    int direction;     // +1 for Left to Right & -1 for Right to left, 0 = stationary
-};
-
-// Axis and Discs Globals - Can be changed for different levels
-const size_t NUM_DISCS = 6;
-const double AXIS_HEIGHT = 3.0;
-
-struct Axis {
-    CustomPoint positions[NUM_DISCS];
-    int occupancy_val[NUM_DISCS];
-};
-
-struct GameBoard {
-    double x_min, y_min, x_max, y_max; //Base in XY-Plane
-    double axis_base_rad;               //Axis's base radius
-    Axis axis[3];
-};
-
-struct solution_pair {
-    size_t f, t;         //f = from, t = to
-};
-
 //Game Settings
-Disk discs[NUM_DISCS];
-GameBoard t_board;
-ActiveDisc active_disc;
-list<solution_pair> sol;
-bool to_solve = false;
+Simulation sim;
 
 //Globals for window, time, FPS
 double FOV = 45.0;
-size_t FPS = 60;
-size_t prev_time = 0;
 size_t window_width = 600, window_height = 600;
+double view_scale = 1.0;      // Camera distance and far plane scale for large grids
+
+//The window's simulation time is GLUT's elapsed time
+class GlutClock : public SimClock {
+public:
+    uint32_t now_ms() const { return glutGet(GLUT_ELAPSED_TIME); }
+};
+GlutClock glut_clock;
+
+//Load measurement, printed once per second in grid mode
+size_t stat_frames = 0, stat_ticks = 0, stat_drawn = 0;
+double stat_render_ms = 0.0, stat_sim_ms = 0.0;
+size_t stat_last_print = 0;
+
+//Startup: the disc meshes are prepared on a thread while the window is created,
+//from a cache mapped in place when an earlier launch has generated them
+const char* const MESH_CACHE_PATH = "hanoi_meshes.bin";
+const int TORUS_SIDES = 10, TORUS_RINGS = 100;
+MeshCache mesh_cache;
+thread mesh_thread;
+size_t meshes_mapped = 0, meshes_built = 0;
+double mesh_prepare_ms = 0.0, mesh_wait_ms = 0.0;
+
+//--startup-trace: time of each startup phase since main was entered
+bool startup_trace = false;
+chrono::steady_clock::time_point startup_begin;
+vector<pair<string, double> > startup_marks;
+
+//Input is coalesced per frame: the handlers only accumulate, display_handler applies
+struct PendingInput {
+    bool camera, light;    // Angles changed since the last frame
+    int fov_steps;         // Net wheel steps
+};
+PendingInput pending_input = { false, false, 0 };
+
+//Input to display latency: live events wait here until the frame showing them is swapped
+vector<chrono::steady_clock::time_point> input_times;
+vector<double> input_latency_ms;   // Samples since the last report
+bool input_latency_report = false;
+chrono::steady_clock::time_point input_latency_last;
+
+//Solution statistics shown by the I key are also written here
+const char* const STATS_PATH = "hanoi_stats.json";
+
+//Session recording and replay
+SessionWriter session_out;
+SessionReader session_in;
+size_t session_start = 0;      // GLUT time the recording or replay started at
+size_t replay_diverged = 0;    // Replayed moves that differ from the recorded ones
+
+//Play mode: the player moves discs by clicking axis or discs
+struct PickHit {
+    size_t board;
+    int axis;
+    int disc;          // -1 when an axis was hit
+    double t;          // Distance along the ray
+};
+int play_mode = 0;
+size_t play_board = 0;         // Board the hints are given for
+int play_from = -1;            // Selected source axis
+size_t play_moves = 0;
+solution_pair hint_move;
+uint64_t hint_distance = 0;
+int hint_disc = -1;
+GLdouble pick_model[16], pick_proj[16];    // Matrices of the last frame, for CPU picking
+GLint pick_viewport[4];
 
 void initialize();
 void initialize_game();
 void display_handler();
 void reshape_handler(int w, int h);
 void keyboard_handler(unsigned char key, int x, int y);
+void keyboard_input(unsigned char key, int x, int y);
 void DrawAxe(double x, double y, double r, double h);
 void anim_handler();
 void mouseWheel(int dir);
+void note_input();
+void apply_input();
 void visible(int vis);
 void toggleFullScreen();
-void move_disc(int from_axis, int to_axis);
-CustomPoint get_inerpolated_coordinate(CustomPoint v1, CustomPoint v2, double u);
-void move_stack(int n, int f, int t); // Hanoi Algorithem
+void togglePlayMode();
+void next_variant();
+void toggleCompression();
+void show_solution_stats();
+bool pick(int x, int y, PickHit& hit);
+void play_pick(PickHit const& hit);
+bool play_move(size_t board, int from_axis, int to_axis);
+void update_hint();
+void togglePipeline();
+void on_solver_move(void*, size_t board, size_t f, size_t t, size_t discs);
 void menu(int); // Menu handling function declaration
+void menu_input(int);
 int main(int argc, char** argv);
 
 
@@ -223,12 +246,25 @@ void drawFloor(void)
 GLfloat floorPlane[4];
 GLfloat floorShadow[4][4];
 
+uint32_t session_time()
+{
+    return sim.clock->now_ms() - session_start;
+}
+
 /* ARGSUSED2 */
 void mouse(int button, int state, int x, int y)
 {
+    if (session_in.is_open())
+        return;         // The replayed session drives camera and light
+    note_input();
     switch(button) {
         case GLUT_LEFT_BUTTON:
             if (state == GLUT_DOWN) {
+                PickHit hit;
+                if (play_mode && pick(x, y, hit)) {
+                    play_pick(hit);
+                    break;
+                }
                 moving = 1;
                 startx = x;
                 starty = y;
@@ -256,48 +292,93 @@ void mouse(int button, int state, int x, int y)
     }
 }
 
+//Only accumulates, the angles reach the session log and the screen once per frame
 void motion(int x, int y)
 {
+    if (session_in.is_open())
+        return;
     if (moving) {
         angle = angle + (x - startx);
         angle2 = angle2 + (y - starty);
         startx = x;
         starty = y;
-        glutPostRedisplay();
+        pending_input.camera = true;
+        note_input();
     }
     if (lightManualMoving) {
         lightAngle += (x - lightStartX)/80.0;
         lightHeight += (lightStartY - y)/40.0;
         lightStartX = x;
         lightStartY = y;
-        glutPostRedisplay();
+        pending_input.light = true;
+        note_input();
     }
 }
 
 void mouseWheel(int dir)
 {
-    if (dir > 0)
-    {
-        if (FOV > 99) FPS = 100;
-        else FOV += 1;
-        cout << "(+) FOV " << endl;
-    }
-    else
-    {
-        if (FOV <= 10) FPS = 10;
-        else FOV -= 1;
-        cout << "(-) FOV " << endl;
-    }
+    session_out.write(session_time(), EV_FOV, dir);
+    pending_input.fov_steps += (dir > 0) ? 1 : -1;
+    glutPostRedisplay();
+}
+
+//Timestamps a live input event and asks for the frame that will show it
+void note_input()
+{
+    input_times.push_back(chrono::steady_clock::now());
+    glutPostRedisplay();
+}
+
+void set_projection()
+{
     glMatrixMode(GL_PROJECTION);
     glLoadIdentity();
     gluPerspective(
             /* field of view in degree */ FOV,
             /* aspect ratio */   (GLfloat)window_width/(GLfloat)window_height,
             /* Z near */                  1.0,
-            /* Z far */                  100.0
+            /* Z far */                  100.0 * view_scale
     );
     glMatrixMode(GL_MODELVIEW);
-    glutPostRedisplay();
+}
+
+//Applies the input accumulated since the last frame, called before drawing it
+void apply_input()
+{
+    if (pending_input.camera)
+        session_out.write(session_time(), EV_CAMERA, 0, angle, angle2);
+    if (pending_input.light)
+        session_out.write(session_time(), EV_LIGHT, 0, lightAngle, lightHeight);
+    if (pending_input.fov_steps != 0) {
+        FOV = max(10.0, min(100.0, FOV + pending_input.fov_steps));
+        set_projection();
+        cout << "FOV " << FOV << endl;
+    }
+    pending_input.camera = pending_input.light = false;
+    pending_input.fov_steps = 0;
+}
+
+//Closes the latency of the input shown by the frame just swapped, reported once per second
+void input_shown()
+{
+    chrono::steady_clock::time_point now = chrono::steady_clock::now();
+    for (size_t i = 0; i < input_times.size(); i++)
+        input_latency_ms.push_back(chrono::duration<double, milli>(now - input_times[i]).count());
+    input_times.clear();
+
+    if (!input_latency_report || input_latency_ms.empty() ||
+        now - input_latency_last < chrono::seconds(1))
+        return;
+
+    vector<double>& v = input_latency_ms;
+    sort(v.begin(), v.end());
+    cout << "Input: " << v.size() << " events"
+         << "  p50: " << v[v.size() / 2] << " ms"
+         << "  p90: " << v[v.size() * 9 / 10] << " ms"
+         << "  p99: " << v[v.size() * 99 / 100] << " ms"
+         << "  max: " << v.back() << " ms" << endl;
+    v.clear();
+    input_latency_last = now;
 }
 
 void special(int k, int x, int y)
@@ -312,6 +393,25 @@ void print_info()
     cout << "ESC:\tSair" << endl;
     cout << "S:\t\tStart" << endl;
     cout << "+/-:\tControla velocidade" << endl;
+    cout << "O:\t\tAnimacao em pipeline" << endl;
+    cout << "P:\t\tModo jogo (clique na haste de origem e depois na de destino)" << endl;
+    cout << "I:\t\tEstatisticas da solucao (exportadas em " << STATS_PATH << ")" << endl;
+    cout << "V:\t\tProxima variante (classic, cyclic, adjacent, double, bicolor)" << endl;
+    cout << "C:\t\tCompressao: sub-torres de ate 2^8, 2^16, 2^32 ou todos os movimentos por tick" << endl;
+    cout << "--grid CxR:\tGrade de tabuleiros" << endl;
+    cout << "--record F:\tGrava a sessao" << endl;
+    cout << "--replay F:\tReproduz uma sessao gravada" << endl;
+    cout << "--checkpoint F:\tRetoma de F e grava nele a cada 10 s (--checkpoint-every S)" << endl;
+    cout << "--serve S:\tServico de consultas no socket S (--threads N)" << endl;
+    cout << "--stats N [K0 K1]:\tEstatisticas dos movimentos [K0, K1) em JSON" << endl;
+    cout << "--discs N|A-B:\tDiscos por tabuleiro" << endl;
+    cout << "--variant V:\tRegras do quebra-cabeca (classic, cyclic, adjacent, double, bicolor)" << endl;
+    cout << "--compress M:\tAplica de uma vez as sub-torres de ate M movimentos" << endl;
+    cout << "--moves N [--variant V] [--from K]:\tImprime a solucao, um movimento \"f t\" por linha" << endl;
+    cout << "--four-peg N [--from S] [--to S]:\tSolucao otima com quatro pinos (--pdb-dir D, --max-nodes M, --print)," << endl;
+    cout << "\t\tde torre a torre ate " << FOURPEG_MAX_DISCS << " discos, entre estados quaisquer ate cerca de " << FOURPEG_SEARCH_DISCS << endl;
+    cout << "--startup-trace:\tTempo de cada fase ate o primeiro quadro" << endl;
+    cout << "--input-latency:\tPercentis da latencia entre a entrada e o quadro que a mostra" << endl;
     cout << "-----------------------------" << endl;
     cout << "Grupo:" << endl;
     cout << "\tJefferson Alves" << endl;
@@ -319,13 +419,280 @@ void print_info()
     cout << "-----------------------------" << endl;
 }
 
+const char* record_path = NULL;
+const char* replay_path = NULL;
+
+//Checkpoints of the running scene
+const char* checkpoint_path = NULL;
+size_t checkpoint_every_ms = 10000;
+size_t checkpoint_last = 0;
+CheckpointWriter checkpoint_out;
+Checkpoint resume_point;       // Loaded by open_checkpoint, applied once the scene is laid out
+bool resuming = false;
+
+// Parses the options left over by glutInit
+void parse_args(int argc, char** argv)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+        if (arg == "--grid" && i + 1 < argc) {
+            unsigned c = 0, r = 0;
+            if (sscanf(argv[++i], "%ux%u", &c, &r) == 2 && c > 0 && r > 0) {
+                sim.grid_cols = c;
+                sim.grid_rows = r;
+            }
+        } else if (arg == "--discs" && i + 1 < argc) {
+            unsigned a = 0, b = 0;
+            int n = sscanf(argv[++i], "%u-%u", &a, &b);
+            if (n == 1) b = a;
+            if (n >= 1 && a > 0 && a <= b && b <= MAX_DISCS) {
+                sim.grid_min_discs = a;
+                sim.grid_max_discs = b;
+            }
+        } else if (arg == "--variant" && i + 1 < argc) {
+            int v = variant_from_name(argv[++i]);
+            if (v >= 0) sim.variant = v;
+            else cout << "Variante desconhecida: " << argv[i] << endl;
+        } else if (arg == "--compress" && i + 1 < argc) {
+            sim.compress_moves = strtoull(argv[++i], NULL, 10);
+        } else if (arg == "--pipeline" && i + 1 < argc) {
+            sim.pipeline_depth = max(1, atoi(argv[++i]));
+        } else if (arg == "--record" && i + 1 < argc) {
+            record_path = argv[++i];
+        } else if (arg == "--replay" && i + 1 < argc) {
+            replay_path = argv[++i];
+        } else if (arg == "--checkpoint" && i + 1 < argc) {
+            checkpoint_path = argv[++i];
+        } else if (arg == "--startup-trace") {
+            startup_trace = true;
+        } else if (arg == "--input-latency") {
+            input_latency_report = true;
+        } else if (arg == "--checkpoint-every" && i + 1 < argc) {
+            checkpoint_every_ms = max(1, atoi(argv[++i])) * 1000;
+        } else {
+            cout << "Opcao desconhecida: " << arg << endl;
+        }
+    }
+}
+
+void close_session()
+{
+    session_out.close();
+    session_in.close();
+}
+
+// Opens the session file given on the command line, a replay restores the recorded scene
+void open_session()
+{
+    if (replay_path) {
+        if (!session_in.open(replay_path)) {
+            cout << "Sessao invalida: " << replay_path << endl;
+            exit(1);
+        }
+        SessionHeader const& h = session_in.header();
+        sim.grid_cols = h.grid_cols;
+        sim.grid_rows = h.grid_rows;
+        sim.grid_min_discs = h.min_discs;
+        sim.grid_max_discs = h.max_discs;
+        sim.pipeline_depth = h.pipeline_depth;
+        sim.variant = (h.variant < V_COUNT) ? (HANOI_VARIANT)h.variant : V_CLASSIC;
+        sim.compress_moves = h.compress_moves;
+        cout << "Replay: " << session_in.size() << " eventos" << endl;
+    } else if (record_path) {
+        SessionHeader h;
+        h.grid_cols = sim.grid_cols;
+        h.grid_rows = sim.grid_rows;
+        h.min_discs = sim.grid_min_discs;
+        h.max_discs = sim.grid_max_discs;
+        h.pipeline_depth = sim.pipeline_depth;
+        h.variant = sim.variant;
+        h.compress_moves = sim.compress_moves;
+        if (!session_out.open(record_path, h)) {
+            cout << "Nao foi possivel gravar em " << record_path << endl;
+            exit(1);
+        }
+    }
+    atexit(close_session);
+}
+
+CheckpointView checkpoint_view()
+{
+    CheckpointView v;
+    v.angle = angle;
+    v.angle2 = angle2;
+    v.light_angle = lightAngle;
+    v.light_height = lightHeight;
+    v.fov = FOV;
+    v.light_auto_move = lightAutoMove;
+    v.directional_light = directionalLight;
+    v.fps = sim.FPS;
+    return v;
+}
+
+//Hands a snapshot to the writer thread every checkpoint_every_ms, the tick never waits for the disk
+void save_checkpoint(size_t curr_time)
+{
+    if (!checkpoint_out.is_open() || curr_time - checkpoint_last < checkpoint_every_ms)
+        return;
+    checkpoint_last = curr_time;
+    string blob;
+    checkpoint_capture(sim, checkpoint_view(), blob);
+    checkpoint_out.submit(blob);
+}
+
+//The last snapshot is taken on the way out
+void close_checkpoint()
+{
+    string blob;
+    checkpoint_capture(sim, checkpoint_view(), blob);
+    checkpoint_out.submit(blob);
+    checkpoint_out.stop();
+}
+
+// Loads the checkpoint given on the command line, its scene replaces the configured one
+void open_checkpoint()
+{
+    if (!checkpoint_path)
+        return;
+    if (!replay_path && checkpoint_load(checkpoint_path, resume_point)) {
+        // A recording starts from a fresh scene, a resumed one could not be replayed
+        if (record_path) {
+            cout << "--record nao pode retomar o checkpoint " << checkpoint_path << ", apague-o ou use outro arquivo" << endl;
+            exit(1);
+        }
+        checkpoint_configure(sim, resume_point);
+        resuming = true;
+    }
+    checkpoint_out.start(checkpoint_path);
+    atexit(close_checkpoint);
+}
+
+//Restores the boards and the view of the loaded checkpoint, once initialize_game has laid out its scene
+void resume_checkpoint()
+{
+    if (!resuming)
+        return;
+    checkpoint_apply(sim, resume_point);
+    CheckpointView const& v = resume_point.header.view;
+    angle = v.angle;
+    angle2 = v.angle2;
+    lightAngle = v.light_angle;
+    lightHeight = v.light_height;
+    FOV = v.fov;
+    lightAutoMove = v.light_auto_move;
+    directionalLight = v.directional_light;
+    resuming = false;
+    cout << "Retomado de " << checkpoint_path << " (" << sim.ticks << " ticks)" << endl;
+}
+
+void trace_startup(const char* phase)
+{
+    startup_marks.push_back(make_pair(string(phase), chrono::duration<double, milli>(chrono::steady_clock::now() - startup_begin).count()));
+}
+
+void print_startup_trace()
+{
+    cout << "Startup (ms desde main):" << endl;
+    double prev = 0.0;
+    for (size_t i = 0; i < startup_marks.size(); i++)
+    {
+        printf("  %-14s %8.1f  (+%.1f)\n", startup_marks[i].first.c_str(), startup_marks[i].second,
+               startup_marks[i].second - prev);
+        prev = startup_marks[i].second;
+    }
+    printf("  malhas: %zu do cache, %zu geradas, %.1f ms em segundo plano, %.1f ms de espera\n",
+           meshes_mapped, meshes_built, mesh_prepare_ms, mesh_wait_ms);
+}
+
+//Runs on mesh_thread: maps the cache, generates the tori it lacks and saves it for the next launch
+void prepare_meshes(vector<pair<double, double> > tori)
+{
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    mesh_cache.open(MESH_CACHE_PATH);
+    for (size_t i = 0; i < tori.size(); i++)
+    {
+        MeshKey key = torus_key(tori[i].first, tori[i].second, TORUS_SIDES, TORUS_RINGS);
+        MeshView view;
+        if (mesh_cache.find(key, view)) {
+            meshes_mapped++;
+            continue;
+        }
+        Mesh mesh;
+        build_torus(tori[i].first, tori[i].second, TORUS_SIDES, TORUS_RINGS, mesh);
+        mesh_cache.add(key, mesh);
+        meshes_built++;
+    }
+    if (mesh_cache.dirty())
+        mesh_cache.save(MESH_CACHE_PATH);
+    mesh_prepare_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+//The cache belongs to the main thread once this returns
+void wait_meshes()
+{
+    if (!mesh_thread.joinable())
+        return;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    mesh_thread.join();
+    mesh_wait_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+//Starts preparing the disc meshes of the scene, once it is laid out
+void start_meshes()
+{
+    map<MeshKey, pair<double, double> > tori;
+    for (size_t k = 0; k < sim.puzzles.size(); k++)
+    {
+        Puzzle const& p = sim.puzzles[k];
+        for (size_t i = 0; i < p.num_discs; i++)
+            tori[torus_key(disc_tube(p), disc_radius(p, i), TORUS_SIDES, TORUS_RINGS)] = make_pair(disc_tube(p), disc_radius(p, i));
+    }
+    vector<pair<double, double> > list;
+    for (map<MeshKey, pair<double, double> >::iterator it = tori.begin(); it != tori.end(); ++it)
+        list.push_back(it->second);
+    mesh_thread = thread(prepare_meshes, list);
+    atexit(wait_meshes);
+}
+
+//The benchmark build (bench.cpp) provides its own main
+#ifndef HANOI_BENCHMARK
 int main(int argc, char** argv)
 {
+    startup_begin = chrono::steady_clock::now();
+
+    //The query service and the statistics run headless, without GLUT
+    for (int i = 1; i < argc; i++)
+    {
+        if (string(argv[i]) == "--serve")
+            return server_main(argc, argv);
+        if (string(argv[i]) == "--stats")
+            return stats_main(argc, argv);
+        if (string(argv[i]) == "--moves")
+            return moves_main(argc, argv);
+        if (string(argv[i]) == "--four-peg")
+            return fourpeg_main(argc, argv);
+    }
+
     glutInit(&argc, argv);
+    trace_startup("glutInit");
+    sim.clock = &glut_clock;
+    sim.on_move = on_solver_move;
+    parse_args(argc, argv);
+    open_checkpoint();  //Before the session, a refused resume must not leave an empty recording behind
+    open_session();
+
+    //The scene needs no GL, so its meshes are generated while the window is created
+    initialize_game();  //Initializing Game State
+    resume_checkpoint();
+    start_meshes();
+    trace_startup("scene");
+
     glutInitDisplayMode(GLUT_RGB | GLUT_DOUBLE | GLUT_DEPTH | GLUT_STENCIL | GLUT_MULTISAMPLE);
     glutInitWindowSize(window_width, window_height);
     glutCreateWindow("Torres de Hanoi");
     glutFullScreen();
+    trace_startup("window");
     print_info();
 
     /* Register GLUT callbacks. */
@@ -334,15 +701,14 @@ int main(int argc, char** argv)
     glutMotionFunc(motion);
     glutVisibilityFunc(visible);
     glutReshapeFunc(reshape_handler);
-    glutKeyboardFunc(keyboard_handler);
+    glutKeyboardFunc(keyboard_input);
     glutIdleFunc(anim_handler);
     glutSpecialFunc(special);
 
-    initialize_game();  //Initializing Game State
     initialize();       //Initializing OpenGL
 
     // Create a menu
-    glutCreateMenu(menu);
+    glutCreateMenu(menu_input);
     glutAddMenuEntry("Help (H)", MENU_HELP);
     glutAddMenuEntry("Solve (S)", MENU_SOLVE);
     glutAddMenuEntry("Increase Speed (+)", MENU_INCREASE_SPEED);
@@ -350,6 +716,11 @@ int main(int argc, char** argv)
     glutAddMenuEntry("----------------------", M_NONE);
     glutAddMenuEntry("Toggle pause", M_PAUSE);
     glutAddMenuEntry("Toggle light auto motion", LIGHT_AUTO_MOTION);
+    glutAddMenuEntry("Toggle pipelined animation (O)", MENU_PIPELINE);
+    glutAddMenuEntry("Toggle play mode (P)", MENU_PLAY);
+    glutAddMenuEntry("Solution statistics (I)", MENU_STATS);
+    glutAddMenuEntry("Next variant (V)", MENU_VARIANT);
+    glutAddMenuEntry("Cycle move compression (C)", MENU_COMPRESS);
     glutAddMenuEntry("----------------------", M_NONE);
     glutAddMenuEntry("Positional light", M_POSITIONAL);
     glutAddMenuEntry("Directional light", M_DIRECTIONAL);
@@ -359,10 +730,12 @@ int main(int argc, char** argv)
     glutAttachMenu(GLUT_RIGHT_BUTTON);
 
     findPlane(floorPlane, floorVertices[1], floorVertices[2], floorVertices[3]);
+    trace_startup("gl setup");
 
     glutMainLoop();
     return 0;
 }
+#endif
 
 void initialize()
 {
@@ -378,7 +751,7 @@ void initialize()
 
 
     glMatrixMode(GL_MODELVIEW);
-    gluLookAt(0.0, 0.0, 30.0,  /* eye */
+    gluLookAt(0.0, 0.0, 30.0 * view_scale,  /* eye */
               0.0, 2.0, 0.0,      /* center */
               0.0, 1.0, 0.0);      /* up is in postivie Y direction */
 
@@ -391,71 +764,30 @@ void initialize()
     glEnable(GL_LIGHTING);
 
     //Globals initializations
-    prev_time = glutGet(GLUT_ELAPSED_TIME);
+    sim.prev_time = sim.clock->now_ms();
+    session_start = sim.prev_time;
 }
 
 void initialize_game()
 {
-    //Initializing 1)GameBoard t_board 2) Discs discs  3) ActiveDisc active_disc
-    // State
-
-    //1) Initializing GameBoard
-    t_board.axis_base_rad = 1.0;
-    t_board.x_min = 0.0;
-    t_board.x_max = 10 * t_board.axis_base_rad;
-    t_board.y_min = 0.0;
-    t_board.y_max = 3 * t_board.axis_base_rad;
-
-    double x_center = 0;
-    double y_center = 0;
-    double dx = (t_board.x_max - t_board.x_min) / 3.0; //Since 3 Axis
-//    double r = t_board.axis_base_rad;
-
-    //Initializing axis Occupancy value
-    for (size_t i = 0; i < 3; i++)
-    {
-        for (size_t h = 0; h < NUM_DISCS; h++)
-        {
-            if (i == 0)
-            {
-                t_board.axis[i].occupancy_val[h] = NUM_DISCS - 1 - h;
-            }
-            else t_board.axis[i].occupancy_val[h] = -1;
-        }
-    }
+    initialize_simulation(sim);
 
-    //Initializing Axis positions
-    for (size_t i = 0; i < 3; i++)
-    {
-        for (size_t h = 0; h < NUM_DISCS; h++)
-        {
-            double x = x_center + ((int)i - 1) * dx;
-            double y = y_center;
-            double z = (h + 1) * 0.3;
-            CustomPoint& pos_to_set = t_board.axis[i].positions[h];
-            pos_to_set.x = x;
-            pos_to_set.y = y;
-            pos_to_set.z = z;
-        }
-    }
+    double width = sim.grid_cols * GRID_SPACING_X;
+    double depth = sim.grid_rows * GRID_SPACING_Z;
+    view_scale = max(1.0, max(width, depth) / 24.0);
 
-    //2) Initializing Discs
-    for (size_t i = 0; i < NUM_DISCS; i++)
+    //Floor grows with the grid
+    for (size_t i = 0; i < 4; i++)
     {
-        discs[i].position = t_board.axis[0].positions[NUM_DISCS - i - 1];
+        floorVertices[i][0] = (floorVertices[i][0] < 0 ? -16.0 : 16.0) * view_scale;
+        floorVertices[i][2] = (floorVertices[i][2] < 0 ? -16.0 : 16.0) * view_scale;
     }
-    //3) Initializing Active Disc
-    active_disc.disc_index = -1;
-    active_disc.is_in_motion = false;
-    active_disc.step_u = 0.025;
-    active_disc.u = 0.0;
-    active_disc.direction = 0;
 }
 
 //Draw function for drawing a cylinder given position and radius and height
 void DrawAxe(double x, double y, double r, double h)
 {
-    GLUquadric* q = gluNewQuadric();
+    static GLUquadric* q = gluNewQuadric();
     GLint slices = 50;
     GLint stacks = 10;
     glPushMatrix();
@@ -464,17 +796,13 @@ void DrawAxe(double x, double y, double r, double h)
     glTranslatef(0, 0, h);
     gluDisk(q, 0, r, slices, stacks);
     glPopMatrix();
-    gluDeleteQuadric(q);
 }
 
 //Draw function for drawing axis on a given game board i.e. base
 void DrawBoardAndAxis(GameBoard const& board)
 {
-    //Materials,
-    GLfloat mat_yellow[] = { 1.0f, 1.0f, 0.0f, 1.0f };
     glPushMatrix();
     //Drawing axis and Pedestals
-    glMaterialfv(GL_FRONT, GL_AMBIENT_AND_DIFFUSE, mat_yellow);
     glRotatef(-90,1,0,0);
     double r = board.axis_base_rad;
     for (size_t i = 0; i < 3; i++)
@@ -486,78 +814,198 @@ void DrawBoardAndAxis(GameBoard const& board)
     glPopMatrix();
 }
 
-// Draw function for drawing discs
-void draw_discs()
+//Every board has the same axis layout, so it is compiled once into a display list
+GLuint board_list(GameBoard const& board)
 {
-    int slices = 100;
-    int stacks = 10;
+    static GLuint list = 0;
+    if (list == 0) {
+        list = glGenLists(1);
+        glNewList(list, GL_COMPILE);
+        DrawBoardAndAxis(board);
+        glEndList();
+    }
+    return list;
+}
+
+//Display list of a torus, compiled on first use from the mesh cache
+GLuint torus_list(double tube, double rad)
+{
+    static map<MeshKey, GLuint> lists;
+    MeshKey key = torus_key(tube, rad, TORUS_SIDES, TORUS_RINGS);
+
+    GLuint& list = lists[key];
+    if (list == 0) {
+        wait_meshes();
+        MeshView m;
+        if (!mesh_cache.find(key, m)) {
+            Mesh mesh;
+            build_torus(tube, rad, TORUS_SIDES, TORUS_RINGS, mesh);
+            m = mesh_cache.add(key, mesh);
+        }
 
-    double rad;
+        list = glGenLists(1);
+        glNewList(list, GL_COMPILE);
+        glEnableClientState(GL_VERTEX_ARRAY);
+        glEnableClientState(GL_NORMAL_ARRAY);
+        glVertexPointer(3, GL_FLOAT, 6 * sizeof(float), m.vertices);
+        glNormalPointer(GL_FLOAT, 6 * sizeof(float), m.vertices + 3);
+        glDrawElements(GL_TRIANGLES, m.index_count, GL_UNSIGNED_INT, m.indices);
+        glDisableClientState(GL_NORMAL_ARRAY);
+        glDisableClientState(GL_VERTEX_ARRAY);
+        glEndList();
+    }
+    return list;
+}
+
+const size_t DISC_COLORS = 6;
+
+void disc_color(size_t i, GLfloat material[4])
+{
     GLfloat r, g, b;
-    GLfloat emission[] = { 0.4f, 0.4f, 0.4f, 1.0f };
-    GLfloat no_emission[] = { 0.0f, 0.0f, 0.0f, 1.0f };
-    GLfloat material[] = { 1.0f, 1.0f, 1.0f, 1.0f };
-    for (size_t i = 0; i < NUM_DISCS; i++)
+    switch (i % DISC_COLORS)
     {
-        switch (i)
-        {
-            case 0: r = 1.0f; g = 0.0f; b = 0.0f;
-                break;
-            case 1: r = 0.0f; g = 1.0f; b = 0.0f;
-                break;
-            case 2: r = 0.0f, g = 0.0f; b = 1.0f;
-                break;
-            case 3: r = 1.0f, g = 1.0f; b = 0.0f;
-                break;
-            case 4: r = 0.0f, g = 1.0f; b = 1.0f;
-                break;
-            case 5: r = 1.0f, g = 0.0f; b = 1.0f;
-                break;
-            default: r = g = b = 1.0f;
-                break;
-        };
+        case 0: r = 1.0f; g = 0.0f; b = 0.0f;
+            break;
+        case 1: r = 0.0f; g = 1.0f; b = 0.0f;
+            break;
+        case 2: r = 0.0f, g = 0.0f; b = 1.0f;
+            break;
+        case 3: r = 1.0f, g = 1.0f; b = 0.0f;
+            break;
+        case 4: r = 0.0f, g = 1.0f; b = 1.0f;
+            break;
+        default: r = 1.0f, g = 0.0f; b = 1.0f;
+            break;
+    };
+    material[0] = r;
+    material[1] = g;
+    material[2] = b;
+    material[3] = 1.0f;
+}
 
-        material[0] = r;
-        material[1] = g;
-        material[2] = b;
-        glMaterialfv(GL_FRONT, GL_AMBIENT_AND_DIFFUSE, material);
+// Draw function for one disc, the material is set by the caller
+void draw_disc(Puzzle const& p, size_t i)
+{
+    size_t s = p.disc_base + i;
+    double tube = disc_tube(p);
+    int d = 0;
+    for (size_t a = 0; a < p.active_discs.size(); a++)
+        if (p.active_discs[a].disc_index == (int)i) d = p.active_discs[a].direction;
+
+    //Play mode: the selected disc and the hinted one glow
+    bool glow = false;
+    if (play_mode && &p == &sim.puzzles[play_board]) {
+        GLfloat selected[] = { 0.4f, 0.4f, 0.4f, 1.0f };
+        GLfloat hinted[] = { 0.0f, 0.35f, 0.0f, 1.0f };
+        if (play_from >= 0 && (int)i == top_disc(p, play_from)) {
+            glMaterialfv(GL_FRONT, GL_EMISSION, selected);
+            glow = true;
+        } else if ((int)i == hint_disc) {
+            glMaterialfv(GL_FRONT, GL_EMISSION, hinted);
+            glow = true;
+        }
+    }
 
-        GLfloat factor = 1.6f;
-        switch (i) {
-            case 0: factor = 0.2;
-                break;
-            case 1: factor = 0.4;
-                break;
-            case 2: factor = 0.6;
-                break;
-            case 3: factor = 0.8;
-                break;
-            case 4: factor = 1.0;
-                break;
-            case 5: factor = 1.2;
-                break;
-            case 6: factor = 1.4;
-                break;
-            default: break;
-        };
-        rad = factor * t_board.axis_base_rad;
-        int d = active_disc.direction;
+    glPushMatrix();
+    glRotatef(-90,1,0,0);
+    glTranslatef(sim.discs.px[s], sim.discs.py[s], sim.discs.pz[s]);
+    double theta = acos(sim.discs.nz[s]);
+    theta *= 640.0f / M_PI;
+    glRotatef(d * theta, 0.0f, 1.0f, 0.0f);
+    glCallList(torus_list(tube, disc_radius(p, i)));
+    glPopMatrix();
+
+    if (glow) {
+        GLfloat no_emission[] = { 0.0f, 0.0f, 0.0f, 1.0f };
+        glMaterialfv(GL_FRONT, GL_EMISSION, no_emission);
+    }
+}
+
+// Draw function for every visible board, batched so each material is set once
+void draw_puzzles(vector<char> const& visible)
+{
+    //Materials,
+    GLfloat mat_yellow[] = { 1.0f, 1.0f, 0.0f, 1.0f };
+    GLfloat material[] = { 1.0f, 1.0f, 1.0f, 1.0f };
 
+    glMaterialfv(GL_FRONT, GL_AMBIENT_AND_DIFFUSE, mat_yellow);
+    for (size_t k = 0; k < sim.puzzles.size(); k++)
+    {
+        if (!visible[k]) continue;
+        Puzzle const& p = sim.puzzles[k];
         glPushMatrix();
-        glRotatef(-90,1,0,0);
-        glTranslatef(discs[i].position.x, discs[i].position.y, discs[i].position.z);
-        double theta = acos(discs[i].normal.z);
-        theta *= 640.0f / M_PI;
-        glRotatef(d * theta, 0.0f, 1.0f, 0.0f);
-        glutSolidTorus(0.2 * t_board.axis_base_rad, rad, stacks, slices);
+        glTranslatef(p.origin.x, p.origin.y, p.origin.z);
+        glCallList(board_list(p.board));
         glPopMatrix();
+    }
 
-        glMaterialfv(GL_FRONT, GL_EMISSION, no_emission);
+    for (size_t c = 0; c < DISC_COLORS; c++)
+    {
+        disc_color(c, material);
+        glMaterialfv(GL_FRONT, GL_AMBIENT_AND_DIFFUSE, material);
+        for (size_t k = 0; k < sim.puzzles.size(); k++)
+        {
+            if (!visible[k]) continue;
+            Puzzle const& p = sim.puzzles[k];
+            //Paired variants show two colours, so a swapped pair or a sorted tower shows
+            size_t colors = variant_paired(p.variant) ? 2 : DISC_COLORS;
+            if (c >= colors) continue;
+            glPushMatrix();
+            glTranslatef(p.origin.x, p.origin.y, p.origin.z);
+            for (size_t i = 0; i < p.num_discs; i++)
+                if (variant_disc_colour(p.variant, i) % colors == c)
+                    draw_disc(p, i);
+            glPopMatrix();
+        }
     }
 }
 
+/* Frustum culling of the board bounding spheres against the current matrices. */
+size_t cull_puzzles(vector<char>& visible)
+{
+    GLfloat proj[16], model[16], clip[16], planes[6][4];
+    glGetFloatv(GL_PROJECTION_MATRIX, proj);
+    glGetFloatv(GL_MODELVIEW_MATRIX, model);
+
+    /* clip = proj * model, both column-major. */
+    for (int c = 0; c < 4; c++)
+        for (int r = 0; r < 4; r++)
+            clip[c * 4 + r] = proj[0 * 4 + r] * model[c * 4 + 0] + proj[1 * 4 + r] * model[c * 4 + 1] +
+                              proj[2 * 4 + r] * model[c * 4 + 2] + proj[3 * 4 + r] * model[c * 4 + 3];
+
+    /* The six planes are row 3 plus or minus rows 0, 1 and 2. */
+    for (int i = 0; i < 6; i++)
+    {
+        int row = i / 2;
+        GLfloat sign = (i % 2) ? -1.0f : 1.0f;
+        for (int c = 0; c < 4; c++)
+            planes[i][c] = clip[c * 4 + 3] + sign * clip[c * 4 + row];
+        GLfloat len = sqrt(planes[i][A] * planes[i][A] + planes[i][B] * planes[i][B] + planes[i][C] * planes[i][C]);
+        for (int c = 0; c < 4; c++)
+            planes[i][c] /= len;
+    }
+
+    size_t drawn = 0;
+    visible.resize(sim.puzzles.size());
+    for (size_t k = 0; k < sim.puzzles.size(); k++)
+    {
+        CustomPoint const& o = sim.puzzles[k].origin;
+        double cy = o.y + AXIS_HEIGHT / 2.0;
+        bool in = true;
+        for (int i = 0; i < 6 && in; i++)
+            in = planes[i][A] * o.x + planes[i][B] * cy + planes[i][C] * o.z + planes[i][D] > -BOARD_BOUNDING_RAD;
+        visible[k] = in;
+        drawn += in;
+    }
+    return drawn;
+}
+
 void display_handler()
 {
+    static vector<char> visible, visible_reflected;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    apply_input();
+    update_hint();
 
     /* Clear; default stencil clears to zero. */
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
@@ -577,6 +1025,12 @@ void display_handler()
     /* Perform scene rotations based on user mouse input. */
     glRotatef(angle2, 1.0, 0.0, 0.0);
     glRotatef(angle, 0.0, 1.0, 0.0);
+    stat_drawn += cull_puzzles(visible);
+
+    /* Keep this frame's matrices so clicks can be ray cast without touching the framebuffer. */
+    glGetDoublev(GL_MODELVIEW_MATRIX, pick_model);
+    glGetDoublev(GL_PROJECTION_MATRIX, pick_proj);
+    glGetIntegerv(GL_VIEWPORT, pick_viewport);
 
     /* Tell GL new light source position. */
     glLightfv(GL_LIGHT0, GL_POSITION, lightPosition);
@@ -626,8 +1080,8 @@ void display_handler()
 
     /* Draw the reflected dinosaur. */
 //    glRotatef(-90, 1, 0, 0);
-    DrawBoardAndAxis(t_board);
-    draw_discs();
+    cull_puzzles(visible_reflected);
+    draw_puzzles(visible_reflected);
 //    glRotatef(90, 1, 0, 0);
 
     /* Disable noramlize again and re-enable back face culling. */
@@ -668,8 +1122,7 @@ void display_handler()
 
     /* Draw "actual" dinosaur, not its reflection. */
 //    glRotatef(-90, 1, 0, 0);
-    DrawBoardAndAxis(t_board);
-    draw_discs();
+    draw_puzzles(visible);
 //    glRotatef(90, 1, 0, 0);
 
     /* Render the projected shadow. */
@@ -698,8 +1151,8 @@ void display_handler()
     glMultMatrixf((GLfloat *) floorShadow);
 
 //    glRotatef(-90, 1, 0, 0);
-    DrawBoardAndAxis(t_board);
-    draw_discs();
+    /* The shadow pass reuses the culling of the unreflected scene. */
+    draw_puzzles(visible);
 //    glRotatef(90, 1, 0, 0);
 
     glPopMatrix();
@@ -746,6 +1199,18 @@ void display_handler()
     glPopMatrix();
 
     glutSwapBuffers();
+    input_shown();
+
+    static bool first_frame = true;
+    if (first_frame) {
+        first_frame = false;
+        trace_startup("first frame");
+        if (startup_trace)
+            print_startup_trace();
+    }
+
+    stat_frames++;
+    stat_render_ms += chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
 }
 
 void reshape_handler(int w, int h)
@@ -754,41 +1219,34 @@ void reshape_handler(int w, int h)
     window_height = h;
 
     glViewport(0, 0, (GLsizei)w, (GLsizei)h);
-
-    glMatrixMode(GL_PROJECTION);
-    glLoadIdentity();
-    gluPerspective(
-            /* field of view in degree */ FOV,
-            /* aspect ratio */   (GLfloat)w/(GLfloat)h,
-            /* Z near */                  1.0,
-            /* Z far */                  100.0
-    );
-
-    glMatrixMode(GL_MODELVIEW);
+    set_projection();
 }
 
-void move_stack(int n, int f, int t)
+//Starts every board whose discs are all still where they started
+void solve()
 {
-    if (n == 1) {
-        solution_pair s;
-        s.f = f;
-        s.t = t;
-        sol.push_back(s); //pushing the (from, to) pair of solution to a list [so that it can be animated later]
-        cout << "From Axis " << f << " to Axis " << t << endl;
-        return;
+    for (size_t k = 0; k < sim.puzzles.size(); k++)
+    {
+        Puzzle& p = sim.puzzles[k];
+        if (!start_solve(sim, p) || !p.verbose)
+            continue;
+        for (SolutionCursor c = p.sol; !c.empty(); c.pop_front())
+            cout << "From Axis " << c.front().f << " to Axis " << c.front().t << endl;
     }
-    move_stack(n - 1, f, 3 - t - f);
-    move_stack(1, f, t);
-    move_stack(n - 1, 3 - t - f, t);
 }
 
-void solve()
+//Live keyboard input, ignored while a session is replayed except for quitting
+void keyboard_input(unsigned char key, int x, int y)
 {
-    move_stack(NUM_DISCS, 0, 2);
+    if (session_in.is_open() && key != 27 && key != 'q' && key != 'Q')
+        return;
+    note_input();
+    keyboard_handler(key, x, y);
 }
 
 void keyboard_handler(unsigned char key, int x, int y)
 {
+    session_out.write(session_time(), EV_KEY, key);
     switch (key)
     {
         case 27:
@@ -802,25 +1260,42 @@ void keyboard_handler(unsigned char key, int x, int y)
             break;
         case 's':
         case 'S':
-            if (t_board.axis[0].occupancy_val[NUM_DISCS - 1] < 0)
-                break;
             solve();
-            to_solve = true;
             break;
         case '+':
-            if (FPS > 980) FPS = 1000;
-            else FPS += 20;
-            cout << "(+) Speed: " << FPS / 5.0 << "%" << endl;
+            if (sim.FPS > 980) sim.FPS = 1000;
+            else sim.FPS += 20;
+            cout << "(+) Speed: " << sim.FPS / 5.0 << "%" << endl;
             break;
         case '-':
-            if (FPS <= 20) FPS = 2;
-            else FPS -= 20;
-            cout << "(-) Speed: " << FPS / 5.0 << "%" << endl;
+            if (sim.FPS <= 20) sim.FPS = 2;
+            else sim.FPS -= 20;
+            cout << "(-) Speed: " << sim.FPS / 5.0 << "%" << endl;
             break;
         case 'f':
         case 'F':
             toggleFullScreen();
             break;
+        case 'o':
+        case 'O':
+            togglePipeline();
+            break;
+        case 'p':
+        case 'P':
+            togglePlayMode();
+            break;
+        case 'i':
+        case 'I':
+            show_solution_stats();
+            break;
+        case 'v':
+        case 'V':
+            next_variant();
+            break;
+        case 'c':
+        case 'C':
+            toggleCompression();
+            break;
         default:
             break;
     };
@@ -837,175 +1312,353 @@ void toggleFullScreen() {
     }
 }
 
-void move_disc(int from_axis, int to_axis)
-{
+//Off, then sub-towers of up to 2^8, 2^16, 2^32 and any number of moves per tick
+void toggleCompression() {
+    if (sim.compress_moves == 0) sim.compress_moves = 1 << 8;
+    else if (sim.compress_moves < (1 << 16)) sim.compress_moves = 1 << 16;
+    else if (sim.compress_moves < ((uint64_t)1 << 32)) sim.compress_moves = (uint64_t)1 << 32;
+    else if (sim.compress_moves != ~(uint64_t)0) sim.compress_moves = ~(uint64_t)0;
+    else sim.compress_moves = 0;
 
-    int d = to_axis - from_axis;
-    if (d > 0) active_disc.direction = 1;
-    else if (d < 0) active_disc.direction = -1;
+    if (sim.compress_moves == 0)
+        cout << "Compressao: desligada" << endl;
+    else
+        cout << "Compressao: sub-torres de ate " << sim.compress_moves << " movimentos por tick" << endl;
+}
 
-    if ((from_axis == to_axis) || (from_axis < 0) || (to_axis < 0) || (from_axis > 2) || (to_axis > 2))
-        return;
+void togglePipeline() {
+    sim.pipeline_depth = (sim.pipeline_depth > 1) ? 1 : PIPELINE_DEPTH;
+    cout << "Pipeline: " << sim.pipeline_depth << " disc(s) in flight" << endl;
+}
 
-    size_t i;
-    for (i = NUM_DISCS - 1; i >= 0 && t_board.axis[from_axis].occupancy_val[i] < 0; i--);
-    if ((i < 0) || (i == 0 && t_board.axis[from_axis].occupancy_val[i] < 0))
-        return; //Either the index < 0 or index at 0 and occupancy < 0 => it's an empty Axis
+//Records a solver move, or checks it against the replayed session
+void log_move(size_t board, size_t f, size_t t, size_t discs)
+{
+    if (session_out.is_open()) {
+        session_out.write(session_time(), EV_MOVE, board, f, t, discs);
+    } else if (session_in.is_open()) {
+        SessionEvent const* e = session_in.peek();
+        if (e && e->type == EV_MOVE && e->arg == board && e->a == f && e->b == t && e->discs == discs)
+            session_in.skip();
+        else replay_diverged++;
+    }
+}
 
-    active_disc.start_pos = t_board.axis[from_axis].positions[i];
+//Solver moves reported by the simulation core: console output and session log
+void on_solver_move(void*, size_t board, size_t f, size_t t, size_t discs)
+{
+    if (sim.puzzles[board].verbose) {
+        if (discs > 1)
+            cout << "From : " << f << " To -> " << t << " (" << discs << " discos)" << endl;
+        else
+            cout << "From : " << f << " To -> " << t << endl;
+    }
+    log_move(board, f, t, discs);
+}
 
-    active_disc.disc_index = t_board.axis[from_axis].occupancy_val[i];
-    active_disc.is_in_motion = true;
-    active_disc.u = 0.0;
+//Refreshes the optimal next move of the played board, called once per frame
+void update_hint()
+{
+    if (!play_mode || play_board >= sim.puzzles.size())
+        return;
 
+    //The closed-form hint only knows the classic rules
+    Puzzle const& p = sim.puzzles[play_board];
+    if (p.variant != V_CLASSIC) {
+        hint_disc = -1;
+        return;
+    }
+    uint8_t pos[MAX_DISCS];
+    solution_pair next = hint_move;
+    board_positions(p, pos);
+    uint64_t distance = hanoi_hint(pos, p.num_discs, 2, &next);
+
+    if (distance != hint_distance || next.f != hint_move.f || next.t != hint_move.t) {
+        if (distance == 0)
+            cout << "Resolvido em " << play_moves << " movimentos!" << endl;
+        else
+            cout << "Dica: " << next.f << " -> " << next.t << "  (faltam " << distance << ")" << endl;
+    }
+    hint_distance = distance;
+    hint_move = next;
+    hint_disc = distance ? top_disc(p, next.f) : -1;
+}
 
-    size_t j;
-    for (j = 0; j < NUM_DISCS - 1 && t_board.axis[to_axis].occupancy_val[j] >= 0; j++);
-    active_disc.dest_pos = t_board.axis[to_axis].positions[j];
+//Applies a move made by the player, false if it is not legal right now
+bool play_move(size_t board, int from_axis, int to_axis)
+{
+    if (board >= sim.puzzles.size())
+        return false;
+    Puzzle& p = sim.puzzles[board];
+    int d = top_disc(p, from_axis);
+    int under = top_disc(p, to_axis);
+    bool fits = under < 0 || (d >= 0 && variant_disc_size(p.variant, under) >= variant_disc_size(p.variant, d));
+    if (p.to_solve || d < 0 || !fits || !variant_allows(p.variant, from_axis, to_axis)
+        || !can_start_move(sim, p, from_axis, to_axis)) {
+        cout << "Movimento invalido" << endl;
+        return false;
+    }
 
-    t_board.axis[from_axis].occupancy_val[i] = -1;
-    t_board.axis[to_axis].occupancy_val[j] = active_disc.disc_index;
+    move_disc(p, from_axis, to_axis);
+    session_out.write(session_time(), EV_PLAY, board, from_axis, to_axis);
+    play_moves++;
+    glutPostRedisplay();
+    return true;
 }
 
-CustomPoint get_inerpolated_coordinate(CustomPoint sp, CustomPoint tp, double u)
+//Nearest hit t >= 0 of the ray o + t * d with the vertical cylinder around (cx, cy), radius r, z in [z0, z1]
+bool ray_cylinder(const double o[3], const double d[3], double cx, double cy, double r, double z0, double z1, double& t_hit)
 {
-    //4 Control points
-    CustomPoint p;
-    double x_center = 0;
-    double y_center = 0;
-
-    double u3 = u * u * u;
-    double u2 = u * u;
+    double best = HUGE_VAL;
+    double ox = o[0] - cx, oy = o[1] - cy;
+
+    //Side
+    double a = d[0] * d[0] + d[1] * d[1];
+    double b = 2 * (ox * d[0] + oy * d[1]);
+    double c = ox * ox + oy * oy - r * r;
+    double disc = b * b - 4 * a * c;
+    if (a > 1e-12 && disc >= 0)
+    {
+        double s = sqrt(disc);
+        double ts[2] = { (-b - s) / (2 * a), (-b + s) / (2 * a) };
+        for (int i = 0; i < 2; i++)
+        {
+            double z = o[2] + ts[i] * d[2];
+            if (ts[i] >= 0 && ts[i] < best && z >= z0 && z <= z1) best = ts[i];
+        }
+    }
 
-    CustomPoint cps[4]; //P1, P2, dP1, dP2
+    //Caps
+    if (fabs(d[2]) > 1e-12)
+    {
+        double zs[2] = { z0, z1 };
+        for (int i = 0; i < 2; i++)
+        {
+            double t = (zs[i] - o[2]) / d[2];
+            double x = ox + t * d[0], y = oy + t * d[1];
+            if (t >= 0 && t < best && x * x + y * y <= r * r) best = t;
+        }
+    }
 
+    if (best == HUGE_VAL)
+        return false;
+    t_hit = best;
+    return true;
+}
 
-    //Hermite Interpolation [Check Reference for equation of spline]
+//Casts the ray under window point (x, y) against the axis and disc bounding cylinders of every board
+bool pick(int x, int y, PickHit& hit)
+{
+    GLdouble near_p[3], far_p[3];
+    double wy = pick_viewport[3] - y;
+    if (!gluUnProject(x, wy, 0.0, pick_model, pick_proj, pick_viewport, &near_p[0], &near_p[1], &near_p[2]) ||
+        !gluUnProject(x, wy, 1.0, pick_model, pick_proj, pick_viewport, &far_p[0], &far_p[1], &far_p[2]))
+        return false;
+
+    hit.t = HUGE_VAL;
+    for (size_t k = 0; k < sim.puzzles.size(); k++)
     {
-        //P1
-        cps[0].x = sp.x;
-        cps[0].y = y_center;
-        cps[0].z = AXIS_HEIGHT + 0.2 * (t_board.axis_base_rad);
+        Puzzle const& p = sim.puzzles[k];
+        GameBoard const& b = p.board;
 
-        //P2
-        cps[1].x = tp.x;
-        cps[1].y = y_center;
-        cps[1].z = AXIS_HEIGHT + 0.2 * (t_board.axis_base_rad);
+        //Into board space, where the axis stand along +z (the boards are drawn rotated -90 around x)
+        double o[3] = { near_p[0] - p.origin.x, -(near_p[2] - p.origin.z), near_p[1] - p.origin.y };
+        double d[3] = { far_p[0] - near_p[0], -(far_p[2] - near_p[2]), far_p[1] - near_p[1] };
+        double t;
 
-        //dP1
-        cps[2].x = (sp.x + tp.x) / 2.0 - sp.x;
-        cps[2].y = y_center;
-        cps[2].z = 2 * cps[1].z; //change 2 * ..
+        double dx = b.axis[1].positions[0].x - b.axis[0].positions[0].x;
+        for (int i = 0; i < 3; i++)
+        {
+            double cx = b.axis[i].positions[0].x;
+            if ((ray_cylinder(o, d, cx, 0.0, b.axis_base_rad * 0.1, 0.0, AXIS_HEIGHT, t) ||
+                 ray_cylinder(o, d, cx, 0.0, b.axis_base_rad, 0.0, 0.1, t)) && t < hit.t) {
+                hit.board = k;
+                hit.axis = i;
+                hit.disc = -1;
+                hit.t = t;
+            }
+        }
 
-        //dP2
-        cps[3].x = tp.x - (tp.x + sp.x) / 2.0;
-        cps[3].y = y_center;
-        cps[3].z = -cps[2].z; //- cps[2].z;
+        double tube = disc_tube(p);
+        for (size_t i = 0; i < p.num_discs; i++)
+        {
+            size_t s = p.disc_base + i;
+            if (ray_cylinder(o, d, sim.discs.px[s], sim.discs.py[s], disc_radius(p, i) + tube,
+                             sim.discs.pz[s] - tube, sim.discs.pz[s] + tube, t) && t < hit.t) {
+                hit.board = k;
+                hit.axis = max(0, min(2, (int)lround((sim.discs.px[s] - b.axis[0].positions[0].x) / dx)));
+                hit.disc = i;
+                hit.t = t;
+            }
+        }
+    }
+    return hit.t != HUGE_VAL;
+}
 
+//First pick selects the source axis, the second one the destination
+void play_pick(PickHit const& hit)
+{
+    if (play_from < 0 || hit.board != play_board) {
+        if (top_disc(sim.puzzles[hit.board], hit.axis) >= 0) {
+            play_board = hit.board;
+            play_from = hit.axis;
+        }
+    } else if (hit.axis != play_from) {
+        play_move(hit.board, play_from, hit.axis);
+        play_from = -1;
+    } else {
+        play_from = -1;
+    }
+    glutPostRedisplay();
+}
 
-        double h0 = 2 * u3 - 3 * u2 + 1;
-        double h1 = -2 * u3 + 3 * u2;
-        double h2 = u3 - 2 * u2 + u;
-        double h3 = u3 - u2;
+//Switches every board to the next variant and lays the scene out again
+void next_variant() {
+    sim.variant = (sim.variant + 1) % V_COUNT;
+    initialize_game();
+    play_from = -1;
+    hint_distance = ~(uint64_t)0;
+    hint_disc = -1;
+    cout << "Variante: " << variant_name(sim.variant) << endl;
+}
 
-        p.x = h0 * cps[0].x + h1 * cps[1].x + h2 * cps[2].x + h3 * cps[3].x;
-        p.y = h0 * cps[0].y + h1 * cps[1].y + h2 * cps[2].y + h3 * cps[3].y;
-        p.z = h0 * cps[0].z + h1 * cps[1].z + h2 * cps[2].z + h3 * cps[3].z;
+void togglePlayMode() {
+    play_mode = 1 - play_mode;
+    play_from = -1;
+    hint_distance = ~(uint64_t)0;
+    cout << "Modo jogo: " << (play_mode ? "ligado" : "desligado") << endl;
+}
 
+//Statistics of the moves made so far on the played (or first) board, the whole solution before it starts
+void show_solution_stats()
+{
+    if (sim.puzzles.empty())
+        return;
+    Puzzle const& p = sim.puzzles[play_mode ? play_board : 0];
+    if (p.variant != V_CLASSIC) {
+        cout << "Estatisticas apenas para a variante classic" << endl;
+        return;
     }
+    uint64_t k1 = p.sol.position();
+    if (k1 == 0)
+        k1 = (p.num_discs >= 64) ? ~(uint64_t)0 : ((uint64_t)1 << p.num_discs) - 1;
 
-    return p;
+    SolutionStats s;
+    if (!solution_stats(p.num_discs, 0, k1, s))
+        return;
+    print_solution_stats(s, cout);
+
+    string json;
+    solution_stats_json(s, json);
+    FILE* f = fopen(STATS_PATH, "w");
+    if (f && fwrite(json.data(), 1, json.size(), f) == json.size())
+        cout << "Exportado: " << STATS_PATH << endl;
+    if (f)
+        fclose(f);
 }
 
-void normalize(CustomPoint& v)
+//Prints render and simulation cost per second when several boards are shown
+void print_stats(size_t curr_time)
 {
-    double length = sqrt(v.x * v.x + v.y * v.y + v.z * v.z);
-    if (length == 0.0) return;
-    v.x /= length;
-    v.y /= length;
-    v.z /= length;
-}
+    if (sim.puzzles.size() < 2 || curr_time - stat_last_print < 1000)
+        return;
 
+    double secs = (curr_time - stat_last_print) / 1000.0;
+    cout << "Boards: " << sim.puzzles.size()
+         << "  Drawn: " << (stat_frames ? stat_drawn / stat_frames : 0)
+         << "  FPS: " << stat_frames / secs
+         << "  Render: " << (stat_frames ? stat_render_ms / stat_frames : 0.0) << " ms"
+         << "  Sim: " << (stat_ticks ? stat_sim_ms / stat_ticks : 0.0) << " ms" << endl;
 
-void anim_handler()
-{
-    int curr_time = glutGet(GLUT_ELAPSED_TIME);
-    int elapsed = curr_time - prev_time; // in ms
-    if (elapsed < 1000 / FPS) return;
+    stat_frames = stat_ticks = stat_drawn = 0;
+    stat_render_ms = stat_sim_ms = 0.0;
+    stat_last_print = curr_time;
+}
 
-    prev_time = curr_time;
+//One animation tick of the whole scene
+void anim_tick(size_t curr_time)
+{
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    session_out.write(session_time(), EV_TICK, lightManualMoving);
 
     if (!lightManualMoving && lightAutoMove) {
         lightAngle += 0.03;
     }
 
-    if (to_solve && active_disc.is_in_motion == false) {
-        solution_pair s = sol.front();
-
-        cout << "From : " << s.f << " To -> " << s.t << endl;
+    bool redraw = step_simulation(sim) || lightAutoMove;
 
-        sol.pop_front();
-        int i;
-        for (i = NUM_DISCS; i >= 0 && t_board.axis[s.f].occupancy_val[i] < 0; i--);
-        int ind = t_board.axis[s.f].occupancy_val[i];
+    stat_ticks++;
+    stat_sim_ms += chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    print_stats(curr_time);
+    save_checkpoint(curr_time);
 
-        if (ind >= 0)
-            active_disc.disc_index = ind;
-
-        move_disc(s.f, s.t);
-        if (sol.size() == 0)
-            to_solve = false;
-    }
+    if (redraw)
+        glutPostRedisplay();
+}
 
-    if (active_disc.is_in_motion)
+//Feeds the replayed events that are due through the same handlers as live input
+void replay_session()
+{
+    uint32_t now = session_time();
+    SessionEvent const* e;
+    while (session_in.is_open() && (e = session_in.poll(now)) != NULL)
     {
-        int ind = active_disc.disc_index;
-        ActiveDisc& ad = active_disc;
-
-        if (ad.u == 0.0 && (discs[ind].position.z < AXIS_HEIGHT + 0.2 * (t_board.axis_base_rad)))
-        {
-            discs[ind].position.z += 0.05;
-            glutPostRedisplay();
-            return;
-        }
-
-        static bool done = false;
-        if (ad.u == 1.0 && discs[ind].position.z > ad.dest_pos.z)
+        switch (e->type)
         {
-            done = true;
-            discs[ind].normal = CustomPoint(0, 0, 1);
-            discs[ind].position.z -= 0.05;
-            glutPostRedisplay();
-            return;
-        }
-
-        ad.u += ad.step_u;
-        if (ad.u > 1.0) {
-            ad.u = 1.0;
+            case EV_CAMERA:
+                angle = e->a;
+                angle2 = e->b;
+                glutPostRedisplay();
+                break;
+            case EV_LIGHT:
+                lightAngle = e->a;
+                lightHeight = e->b;
+                glutPostRedisplay();
+                break;
+            case EV_FOV:
+                mouseWheel(e->arg);
+                break;
+            case EV_KEY:
+                keyboard_handler(e->arg, 0, 0);
+                break;
+            case EV_MENU:
+                menu(e->arg);
+                break;
+            case EV_TICK:
+                lightManualMoving = e->arg;
+                anim_tick(sim.clock->now_ms());
+                lightManualMoving = 0;
+                break;
+            case EV_MOVE:       // Should have been consumed by its tick
+                replay_diverged++;
+                break;
+            case EV_PLAY:
+                play_move(e->arg, e->a, e->b);
+                break;
+            default:
+                break;
         }
+    }
 
-        if (!done) {
-            CustomPoint prev_p = discs[ind].position;
-            CustomPoint p = get_inerpolated_coordinate(ad.start_pos, ad.dest_pos, ad.u);
-            discs[ind].position = p;
-            discs[ind].normal.x = (p - prev_p).x;
-            discs[ind].normal.y = (p - prev_p).y;
-            discs[ind].normal.z = (p - prev_p).z;
-            normalize(discs[ind].normal);
-        }
+    if (session_in.is_open() && session_in.done()) {
+        cout << "Replay concluido: " << session_in.size() << " eventos, "
+             << replay_diverged << " movimentos divergentes" << endl;
+        session_in.close();
+        sim.prev_time = sim.clock->now_ms();
+        if (!animation)
+            glutIdleFunc(NULL);
+    }
+}
 
-        if (ad.u >= 1.0 && discs[ind].position.z <= ad.dest_pos.z) {
-            discs[ind].position.z = ad.dest_pos.z;
-            ad.is_in_motion = false;
-            done = false;
-            ad.u = 0.0;
-            discs[ad.disc_index].normal = CustomPoint(0, 0, 1);
-            ad.disc_index = -1;
-        }
-        glutPostRedisplay();
-    } else if (lightAutoMove) {
-        glutPostRedisplay();
+void anim_handler()
+{
+    if (session_in.is_open()) {
+        replay_session();
+        return;
     }
+
+    if (tick_due(sim))
+        anim_tick(sim.prev_time);
 }
 
 /* When not visible, stop animating.  Restart when visible again. */
@@ -1015,21 +1668,32 @@ void visible(int vis)
         if (animation)
             glutIdleFunc(anim_handler);
     } else {
-        if (!animation)
+        if (!animation && !session_in.is_open())
             glutIdleFunc(NULL);
     }
 }
 
+//Live menu input, ignored while a session is replayed except for exiting
+void menu_input(int item)
+{
+    if (session_in.is_open() && item != MENU_Exit)
+        return;
+    menu(item);
+}
+
 // Menu handling function definition
 void menu(int item)
 {
+    if (item != M_NONE)
+        session_out.write(session_time(), EV_MENU, item);
     switch (item)
     {
         case M_NONE:
             return;
         case M_PAUSE:
             animation = 1 - animation;
-            if (animation) {
+            //A replay keeps polling, paused ticks are simply absent from the log
+            if (animation || session_in.is_open()) {
                 glutIdleFunc(anim_handler);
             } else {
                 glutIdleFunc(NULL);
@@ -1048,24 +1712,36 @@ void menu(int item)
             print_info();
             break;
         case MENU_SOLVE:
-            if (t_board.axis[0].occupancy_val[NUM_DISCS - 1] < 0)
-                break;
             solve();
-            to_solve = true;
             break;
         case MENU_INCREASE_SPEED:
-            if (FPS > 980) FPS = 1000;
-            else FPS += 20;
-            cout << "(+) Speed: " << FPS / 5.0 << "%" << endl;
+            if (sim.FPS > 980) sim.FPS = 1000;
+            else sim.FPS += 20;
+            cout << "(+) Speed: " << sim.FPS / 5.0 << "%" << endl;
             break;
         case MENU_DECREASE_SPEED:
-            if (FPS <= 20) FPS = 2;
-            else FPS -= 20;
-            cout << "(-) Speed: " << FPS / 5.0 << "%" << endl;
+            if (sim.FPS <= 20) sim.FPS = 2;
+            else sim.FPS -= 20;
+            cout << "(-) Speed: " << sim.FPS / 5.0 << "%" << endl;
             break;
         case MENU_FULL_SCREEN:
             toggleFullScreen();
             break;
+        case MENU_PIPELINE:
+            togglePipeline();
+            break;
+        case MENU_PLAY:
+            togglePlayMode();
+            break;
+        case MENU_STATS:
+            show_solution_stats();
+            break;
+        case MENU_VARIANT:
+            next_variant();
+            break;
+        case MENU_COMPRESS:
+            toggleCompression();
+            break;
         case MENU_Exit:
             exit(0);
             break;
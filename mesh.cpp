@@ -0,0 +1,244 @@
+#include "mesh.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+static const char MESH_MAGIC[4] = { 'H', 'M', 'S', 'H' };
+static const uint16_t MESH_VERSION = 1;
+
+struct MeshFileHeader {
+    char magic[4];                   // "HMSH"
+    uint16_t version;
+    uint16_t entry_size;
+    uint64_t count;
+};
+
+bool MeshKey::operator<(MeshKey const& o) const
+{
+    if (tube_um != o.tube_um) return tube_um < o.tube_um;
+    if (radius_um != o.radius_um) return radius_um < o.radius_um;
+    if (sides != o.sides) return sides < o.sides;
+    return rings < o.rings;
+}
+
+static bool same_key(MeshKey const& a, MeshKey const& b)
+{
+    return !(a < b) && !(b < a);
+}
+
+MeshKey torus_key(double tube, double radius, int sides, int rings)
+{
+    MeshKey k;
+    k.tube_um = lround(tube * 1e6);
+    k.radius_um = lround(radius * 1e6);
+    k.sides = sides;
+    k.rings = rings;
+    return k;
+}
+
+void build_torus(double tube, double radius, int sides, int rings, Mesh& out)
+{
+    //(rings + 1) x (sides + 1) grid, the seams repeat their first row and column
+    out.vertices.clear();
+    out.indices.clear();
+    out.vertices.reserve((rings + 1) * (sides + 1) * 6);
+    for (int j = 0; j <= rings; j++)
+    {
+        double phi = 2.0 * M_PI * j / rings;
+        for (int i = 0; i <= sides; i++)
+        {
+            double psi = 2.0 * M_PI * i / sides;
+            double nx = cos(phi) * cos(psi), ny = sin(phi) * cos(psi), nz = sin(psi);
+            out.vertices.push_back(cos(phi) * radius + nx * tube);
+            out.vertices.push_back(sin(phi) * radius + ny * tube);
+            out.vertices.push_back(nz * tube);
+            out.vertices.push_back(nx);
+            out.vertices.push_back(ny);
+            out.vertices.push_back(nz);
+        }
+    }
+
+    out.indices.reserve(rings * sides * 6);
+    for (int j = 0; j < rings; j++)
+        for (int i = 0; i < sides; i++)
+        {
+            uint32_t a = j * (sides + 1) + i, b = a + sides + 1;
+            uint32_t quad[6] = { a, b, a + 1, a + 1, b, b + 1 };
+            out.indices.insert(out.indices.end(), quad, quad + 6);
+        }
+}
+
+MeshCache::MeshCache() : base(NULL), length(0), entries(NULL), count(0)
+{
+}
+
+MeshCache::~MeshCache()
+{
+    close();
+}
+
+bool MeshCache::open(const char* path)
+{
+    close();
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(MeshFileHeader)) {
+        ::close(fd);
+        return false;
+    }
+    void* m = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (m == MAP_FAILED)
+        return false;
+
+    //Every entry must lie inside the file, a truncated cache is simply ignored
+    MeshFileHeader const* h = (MeshFileHeader const*)m;
+    size_t size = st.st_size;
+    bool ok = memcmp(h->magic, MESH_MAGIC, sizeof(h->magic)) == 0 && h->version == MESH_VERSION &&
+              h->entry_size == sizeof(Entry) && h->count <= (size - sizeof(*h)) / sizeof(Entry);
+    const Entry* e = (const Entry*)((const char*)m + sizeof(*h));
+    for (size_t i = 0; ok && i < h->count; i++)
+        ok = e[i].vertex_offset % 4 == 0 && e[i].index_offset % 4 == 0 &&
+             e[i].vertex_offset <= size && (size - e[i].vertex_offset) / (6 * sizeof(float)) >= e[i].vertex_count &&
+             e[i].index_offset <= size && (size - e[i].index_offset) / sizeof(uint32_t) >= e[i].index_count;
+
+    //An index past its vertices would be read by glDrawElements, the cache is rebuilt instead
+    for (size_t i = 0; ok && i < h->count; i++)
+    {
+        const uint32_t* index = (const uint32_t*)((const char*)m + e[i].index_offset);
+        for (uint32_t j = 0; ok && j < e[i].index_count; j++)
+            ok = index[j] < e[i].vertex_count;
+    }
+    if (!ok) {
+        munmap(m, size);
+        return false;
+    }
+
+    base = m;
+    length = size;
+    entries = e;
+    count = h->count;
+    return true;
+}
+
+MeshView MeshCache::view_of(Entry const& e) const
+{
+    MeshView v;
+    v.vertices = (const float*)((const char*)base + e.vertex_offset);
+    v.vertex_count = e.vertex_count;
+    v.indices = (const uint32_t*)((const char*)base + e.index_offset);
+    v.index_count = e.index_count;
+    return v;
+}
+
+bool MeshCache::find(MeshKey const& key, MeshView& view) const
+{
+    for (size_t i = 0; i < count; i++)
+        if (same_key(entries[i].key, key)) {
+            view = view_of(entries[i]);
+            return true;
+        }
+    for (size_t i = 0; i < added.size(); i++)
+        if (same_key(added[i]->key, key)) {
+            Mesh const& m = added[i]->mesh;
+            view.vertices = m.vertices.data();
+            view.vertex_count = m.vertices.size() / 6;
+            view.indices = m.indices.data();
+            view.index_count = m.indices.size();
+            return true;
+        }
+    return false;
+}
+
+MeshView MeshCache::add(MeshKey const& key, Mesh& mesh)
+{
+    Added* a = new Added;
+    a->key = key;
+    a->mesh.vertices.swap(mesh.vertices);
+    a->mesh.indices.swap(mesh.indices);
+    added.push_back(a);
+
+    MeshView v;
+    find(key, v);
+    return v;
+}
+
+bool MeshCache::save(const char* path) const
+{
+    //Mapped entries first, then the new ones, data after the table
+    vector<Entry> table;
+    vector<MeshView> views;
+    for (size_t i = 0; i < count; i++)
+    {
+        table.push_back(entries[i]);
+        views.push_back(view_of(entries[i]));
+    }
+    for (size_t i = 0; i < added.size(); i++)
+    {
+        Entry e;
+        memset(&e, 0, sizeof(e));
+        e.key = added[i]->key;
+        MeshView v;
+        find(e.key, v);
+        table.push_back(e);
+        views.push_back(v);
+    }
+
+    uint64_t offset = sizeof(MeshFileHeader) + table.size() * sizeof(Entry);
+    for (size_t i = 0; i < table.size(); i++)
+    {
+        table[i].vertex_count = views[i].vertex_count;
+        table[i].index_count = views[i].index_count;
+        table[i].vertex_offset = offset;
+        offset += views[i].vertex_count * 6 * sizeof(float);
+        table[i].index_offset = offset;
+        offset += views[i].index_count * sizeof(uint32_t);
+    }
+
+    MeshFileHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, MESH_MAGIC, sizeof(h.magic));
+    h.version = MESH_VERSION;
+    h.entry_size = sizeof(Entry);
+    h.count = table.size();
+
+    string tmp = string(path) + ".tmp";
+    FILE* file = fopen(tmp.c_str(), "wb");
+    if (!file)
+        return false;
+    bool ok = fwrite(&h, sizeof(h), 1, file) == 1 &&
+              fwrite(table.data(), sizeof(Entry), table.size(), file) == table.size();
+    for (size_t i = 0; ok && i < views.size(); i++)
+        ok = fwrite(views[i].vertices, 6 * sizeof(float), views[i].vertex_count, file) == views[i].vertex_count &&
+             fwrite(views[i].indices, sizeof(uint32_t), views[i].index_count, file) == views[i].index_count;
+    ok = (fclose(file) == 0) && ok;
+    if (!ok || rename(tmp.c_str(), path) != 0) {
+        unlink(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+void MeshCache::close()
+{
+    for (size_t i = 0; i < added.size(); i++)
+        delete added[i];
+    added.clear();
+    if (base) {
+        munmap(base, length);
+        base = NULL;
+        entries = NULL;
+        count = 0;
+    }
+}
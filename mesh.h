@@ -0,0 +1,72 @@
+#ifndef HANOI_MESH_H
+#define HANOI_MESH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Triangle meshes built on the CPU, without GL: interleaved position and
+// normal (6 floats per vertex) with 32 bit indices.
+struct Mesh {
+    std::vector<float> vertices;
+    std::vector<uint32_t> indices;
+};
+
+struct MeshView {      // A mesh in place, inside the cache mapping or a Mesh
+    const float* vertices;
+    uint32_t vertex_count;
+    const uint32_t* indices;
+    uint32_t index_count;
+};
+
+struct MeshKey {
+    uint32_t tube_um, radius_um;     // Torus radii in micrometres of the scene unit
+    uint16_t sides, rings;
+
+    bool operator<(MeshKey const& o) const;
+};
+
+// Torus around the z axis, the same surface glutSolidTorus(tube, radius, sides, rings) draws
+void build_torus(double tube, double radius, int sides, int rings, Mesh& out);
+MeshKey torus_key(double tube, double radius, int sides, int rings);
+
+// Versioned binary cache of generated meshes: a header, a table of entries and
+// the vertex and index data, mapped read-only on later launches so cached
+// meshes are used in place. New meshes are kept in memory until save, which
+// rewrites the file through a temporary file and a rename.
+class MeshCache {
+public:
+    MeshCache();
+    ~MeshCache();
+
+    bool open(const char* path);     // False if missing, stale or malformed: the cache starts empty
+    bool find(MeshKey const& key, MeshView& view) const;
+    MeshView add(MeshKey const& key, Mesh& mesh);  // Takes the contents of mesh
+    bool dirty() const { return !added.empty(); }
+    bool save(const char* path) const;
+    void close();
+
+    size_t mapped_count() const { return count; }
+
+private:
+    struct Entry {
+        MeshKey key;
+        uint32_t vertex_count, index_count;
+        uint64_t vertex_offset, index_offset;    // Bytes from the start of the file
+    };
+    struct Added {
+        MeshKey key;
+        Mesh mesh;
+    };
+
+    void* base;
+    size_t length;
+    const Entry* entries;
+    size_t count;
+    std::vector<Added*> added;
+
+    MeshView view_of(Entry const& e) const;
+};
+
+#endif
@@ -0,0 +1,273 @@
+#include "server.h"
+#include "solution.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace std;
+
+static bool read_full(int fd, void* buf, size_t len)
+{
+    char* p = (char*)buf;
+    while (len > 0)
+    {
+        ssize_t r = read(fd, p, len);
+        if (r <= 0) return false;
+        p += r;
+        len -= r;
+    }
+    return true;
+}
+
+static bool write_full(int fd, const void* buf, size_t len)
+{
+    const char* p = (const char*)buf;
+    while (len > 0)
+    {
+        ssize_t w = write(fd, p, len);
+        if (w <= 0) return false;
+        p += w;
+        len -= w;
+    }
+    return true;
+}
+
+static uint64_t moves_of(int n)
+{
+    return (n >= 64) ? ~(uint64_t)0 : ((uint64_t)1 << n) - 1;
+}
+
+static void unpack_state(uint64_t w, uint8_t* pos, int n)
+{
+    for (int i = 0; i < n; i++)
+        pos[i] = (w >> (2 * i)) & 3;
+}
+
+static bool valid_state(const uint8_t* pos, int n)
+{
+    for (int i = 0; i < n; i++)
+        if (pos[i] > 2) return false;
+    return true;
+}
+
+void answer_queries(Query const* q, Answer* out, uint32_t count)
+{
+    uint8_t a[64], b[64];
+    for (uint32_t i = 0; i < count; i++)
+    {
+        Answer& r = out[i];
+        int n = q[i].n;
+        r.r0 = r.r1 = QUERY_ERROR;
+        if (n < 1 || n > 64)
+            continue;
+
+        switch (q[i].op)
+        {
+            case Q_KTH_MOVE:
+                if (q[i].a < moves_of(n)) {
+                    solution_pair s = hanoi_kth_move(n, q[i].a);
+                    r.r0 = s.f;
+                    r.r1 = s.t;
+                }
+                break;
+            case Q_STATE_AFTER:
+                if (q[i].a <= moves_of(n)) {
+                    hanoi_state_after(n, q[i].a, a);
+                    r.r0 = r.r1 = 0;
+                    for (int d = 0; d < n; d++)
+                        (d < 32 ? r.r0 : r.r1) |= (uint64_t)a[d] << (2 * (d % 32));
+                }
+                break;
+            case Q_DISTANCE:
+                if (n <= 32) {
+                    unpack_state(q[i].a, a, n);
+                    unpack_state(q[i].b, b, n);
+                    if (valid_state(a, n) && valid_state(b, n)) {
+                        r.r0 = hanoi_distance(a, b, n);
+                        r.r1 = 0;
+                    }
+                }
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+// Connections with a readable request, queued by the poller for the workers
+struct ReadyQueue {
+    mutex lock;
+    condition_variable wake;
+    deque<int> fds;
+};
+
+// Reads and answers one request, false once the connection has to be closed
+static bool serve_request(int fd, vector<Query>& queries, vector<Answer>& answers)
+{
+    QueryHeader h;
+    if (!read_full(fd, &h, sizeof(h)) || h.magic != QUERY_MAGIC || h.count > QUERY_MAX_BATCH)
+        return false;
+    if (queries.size() < h.count) {
+        queries.resize(h.count);
+        answers.resize(h.count);
+    }
+    if (!read_full(fd, queries.data(), h.count * sizeof(Query)))
+        return false;
+
+    answer_queries(queries.data(), answers.data(), h.count);
+    return write_full(fd, &h, sizeof(h)) && write_full(fd, answers.data(), h.count * sizeof(Answer));
+}
+
+// Every worker answers one request at a time and hands the connection back to the poller,
+// so idle clients hold no worker
+static void worker(ReadyQueue* ready, int epoll_fd)
+{
+    vector<Query> queries;
+    vector<Answer> answers;
+    for (;;)
+    {
+        int fd;
+        {
+            unique_lock<mutex> guard(ready->lock);
+            while (ready->fds.empty())
+                ready->wake.wait(guard);
+            fd = ready->fds.front();
+            ready->fds.pop_front();
+        }
+
+        epoll_event ev;
+        ev.events = EPOLLIN | EPOLLONESHOT;
+        ev.data.fd = fd;
+        if (!serve_request(fd, queries, answers) || epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &ev) != 0)
+            close(fd);
+    }
+}
+
+// Accepts one pending connection into the poll set, false on an error the server cannot outlive
+static bool accept_connection(int listen_fd, int epoll_fd)
+{
+    int fd = accept(listen_fd, NULL, NULL);
+    if (fd < 0) {
+        //Out of descriptors or memory: wait for connections to close instead of spinning
+        if (errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM)
+            this_thread::sleep_for(chrono::milliseconds(100));
+        else if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR && errno != ECONNABORTED) {
+            cerr << "accept: " << strerror(errno) << endl;
+            return false;
+        }
+        return true;
+    }
+
+    //A client that stalls halfway through a request or an answer frees its worker after the timeout
+    timeval timeout;
+    timeout.tv_sec = QUERY_IO_TIMEOUT_S;
+    timeout.tv_usec = 0;
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    epoll_event ev;
+    ev.events = EPOLLIN | EPOLLONESHOT;
+    ev.data.fd = fd;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) != 0)
+        close(fd);
+    return true;
+}
+
+int server_main(int argc, char** argv)
+{
+    string path;
+    int threads = max(1u, thread::hardware_concurrency());
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+        if (arg == "--serve" && i + 1 < argc) path = argv[++i];
+        else if (arg == "--threads" && i + 1 < argc) threads = atoi(argv[++i]);
+    }
+
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof(addr.sun_path) || threads < 1) {
+        cout << "Uso: hanoi --serve SOCKET [--threads N]" << endl;
+        return 1;
+    }
+    strcpy(addr.sun_path, path.c_str());
+
+    //Only a stale socket is replaced: never a file given by mistake, nor the socket of a running server
+    struct stat st;
+    if (lstat(path.c_str(), &st) == 0) {
+        if (!S_ISSOCK(st.st_mode)) {
+            cout << path << " existe e nao e um socket" << endl;
+            return 1;
+        }
+        int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+        bool refused = probe >= 0 && connect(probe, (sockaddr*)&addr, sizeof(addr)) != 0 && errno == ECONNREFUSED;
+        if (probe >= 0)
+            close(probe);
+        if (!refused) {
+            cout << path << " ja esta em uso" << endl;
+            return 1;
+        }
+        unlink(path.c_str());
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    int epoll_fd = epoll_create1(0);
+    epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.fd = fd;
+    if (fd < 0 || bind(fd, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, 128) != 0 ||
+        epoll_fd < 0 || epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+        cout << "Nao foi possivel escutar em " << path << endl;
+        return 1;
+    }
+    cout << "Servindo consultas em " << path << " com " << threads << " threads" << endl;
+
+    ReadyQueue ready;
+    vector<thread> pool;
+    for (int t = 0; t < threads; t++)
+        pool.push_back(thread(worker, &ready, epoll_fd));
+
+    //The poller accepts connections and queues each readable one, the workers do the rest.
+    //The workers never return, so a fatal error ends the process here
+    epoll_event events[64];
+    for (;;)
+    {
+        int count = epoll_wait(epoll_fd, events, 64, -1);
+        if (count < 0 && errno != EINTR) {
+            cerr << "epoll_wait: " << strerror(errno) << endl;
+            exit(1);
+        }
+        for (int i = 0; i < count; i++)
+        {
+            if (events[i].data.fd == fd) {
+                if (!accept_connection(fd, epoll_fd))
+                    exit(1);
+                continue;
+            }
+            {
+                lock_guard<mutex> guard(ready.lock);
+                ready.fds.push_back(events[i].data.fd);
+            }
+            ready.wake.notify_one();
+        }
+    }
+}
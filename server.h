@@ -0,0 +1,52 @@
+#ifndef HANOI_SERVER_H
+#define HANOI_SERVER_H
+
+#include <cstdint>
+
+// Query service: hanoi --serve SOCKET_PATH [--threads N]
+//
+// Clients connect to the Unix domain socket and send any number of requests.
+// A request is a QueryHeader followed by count Query records, and it is
+// answered by a QueryHeader followed by count Answer records, in order. All
+// fields are little-endian. States pack the axis of disc i into bits 2i..2i+1,
+// discs 0..31 in the first word and 32..63 in the second one.
+//
+// Requests, not connections, are handed to the N worker threads, so idle
+// clients hold none. A client stalled halfway through a request or its answer
+// for QUERY_IO_TIMEOUT_S seconds is disconnected.
+enum QUERY_OP
+{
+    Q_KTH_MOVE = 1,    // a = k            -> r0 = from axis, r1 = to axis
+    Q_STATE_AFTER,     // a = k            -> r0, r1 = state after k moves
+    Q_DISTANCE         // a, b = states    -> r0 = fewest moves between them (n <= 32)
+};
+
+const uint32_t QUERY_MAGIC = 0x59525148;   // "HQRY"
+const uint32_t QUERY_MAX_BATCH = 1 << 20;
+const uint64_t QUERY_ERROR = ~(uint64_t)0; // r0 and r1 of a malformed query
+const int QUERY_IO_TIMEOUT_S = 5;
+
+struct QueryHeader {
+    uint32_t magic;
+    uint32_t count;
+};
+
+struct Query {
+    uint8_t op;
+    uint8_t n;         // Discs of the classic transfer from axis 0 to axis 2
+    uint16_t reserved;
+    uint32_t reserved2;
+    uint64_t a, b;
+};
+
+struct Answer {
+    uint64_t r0, r1;
+};
+
+// Answers a batch in place of its queries
+void answer_queries(Query const* q, Answer* out, uint32_t count);
+
+// Entry point of server mode, runs until the process is killed
+int server_main(int argc, char** argv);
+
+#endif
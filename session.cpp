@@ -0,0 +1,120 @@
+#include "session.h"
+
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char SESSION_MAGIC[4] = { 'H', 'R', 'E', 'C' };
+static const uint16_t SESSION_VERSION = 2;
+
+SessionWriter::SessionWriter() : file(NULL)
+{
+}
+
+SessionWriter::~SessionWriter()
+{
+    close();
+}
+
+bool SessionWriter::open(const char* path, SessionHeader const& config)
+{
+    close();
+    file = fopen(path, "wb");
+    if (!file)
+        return false;
+    setvbuf(file, buffer, _IOFBF, sizeof(buffer));
+
+    SessionHeader h = config;
+    memcpy(h.magic, SESSION_MAGIC, sizeof(h.magic));
+    h.version = SESSION_VERSION;
+    h.event_size = sizeof(SessionEvent);
+    if (fwrite(&h, sizeof(h), 1, file) != 1) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void SessionWriter::write(uint32_t time_ms, uint8_t type, uint16_t arg, float a, float b, uint8_t discs)
+{
+    if (!file)
+        return;
+    SessionEvent e;
+    e.time_ms = time_ms;
+    e.type = type;
+    e.discs = discs;
+    e.arg = arg;
+    e.a = a;
+    e.b = b;
+    fwrite(&e, sizeof(e), 1, file);
+}
+
+void SessionWriter::close()
+{
+    if (file) {
+        fclose(file);
+        file = NULL;
+    }
+}
+
+SessionReader::SessionReader() : base(NULL), length(0), events(NULL), count(0), next(0)
+{
+}
+
+SessionReader::~SessionReader()
+{
+    close();
+}
+
+bool SessionReader::open(const char* path)
+{
+    close();
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(SessionHeader)) {
+        ::close(fd);
+        return false;
+    }
+
+    void* m = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (m == MAP_FAILED)
+        return false;
+
+    SessionHeader const* h = (SessionHeader const*)m;
+    if (memcmp(h->magic, SESSION_MAGIC, sizeof(h->magic)) != 0 || h->version != SESSION_VERSION ||
+        h->event_size != sizeof(SessionEvent)) {
+        munmap(m, st.st_size);
+        return false;
+    }
+    madvise(m, st.st_size, MADV_SEQUENTIAL);
+
+    base = m;
+    length = st.st_size;
+    events = (SessionEvent const*)((char const*)m + sizeof(SessionHeader));
+    count = (length - sizeof(SessionHeader)) / sizeof(SessionEvent);
+    next = 0;
+    return true;
+}
+
+SessionEvent const* SessionReader::poll(uint32_t now_ms)
+{
+    if (next >= count || events[next].time_ms > now_ms)
+        return NULL;
+    return &events[next++];
+}
+
+void SessionReader::close()
+{
+    if (base) {
+        munmap(base, length);
+        base = NULL;
+        events = NULL;
+        count = next = 0;
+    }
+}
@@ -0,0 +1,83 @@
+#ifndef HANOI_SESSION_H
+#define HANOI_SESSION_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+
+// Session log: a 24 byte header followed by fixed 16 byte events, so a mapped
+// file can be read in place as an array of SessionEvent.
+enum SESSION_EVENT_TYPE
+{
+    EV_CAMERA = 1,     // a = angle, b = angle2
+    EV_LIGHT,          // a = lightAngle, b = lightHeight
+    EV_FOV,            // arg = wheel direction
+    EV_KEY,            // arg = key
+    EV_MENU,           // arg = menu item
+    EV_TICK,           // One animation tick
+    EV_MOVE,           // arg = board, a = from axis, b = to axis, discs = 1 or the size of a compressed sub-tower
+    EV_PLAY            // Move made in play mode, same fields as EV_MOVE
+};
+
+struct SessionHeader {
+    char magic[4];                 // "HREC"
+    uint16_t version;
+    uint16_t event_size;
+    uint16_t grid_cols, grid_rows; // Scene the session was recorded on
+    uint8_t min_discs, max_discs;
+    uint8_t pipeline_depth;
+    uint8_t variant;               // HANOI_VARIANT, 0 (classic) in older recordings
+    uint64_t compress_moves;       // Compressed playback at the start, 0 animates every move
+};
+
+struct SessionEvent {
+    uint32_t time_ms;              // Since the start of the recording
+    uint8_t type;
+    uint8_t discs;                 // EV_MOVE only
+    uint16_t arg;
+    float a, b;
+};
+
+class SessionWriter {
+public:
+    SessionWriter();
+    ~SessionWriter();
+
+    bool open(const char* path, SessionHeader const& config);
+    bool is_open() const { return file != NULL; }
+    void write(uint32_t time_ms, uint8_t type, uint16_t arg = 0, float a = 0.0f, float b = 0.0f, uint8_t discs = 0);
+    void close();
+
+private:
+    FILE* file;
+    char buffer[1 << 16];
+};
+
+// Replays a session from a read-only mapping, events are never copied
+class SessionReader {
+public:
+    SessionReader();
+    ~SessionReader();
+
+    bool open(const char* path);
+    bool is_open() const { return base != NULL; }
+    SessionHeader const& header() const { return *(SessionHeader const*)base; }
+
+    size_t size() const { return count; }
+    size_t position() const { return next; }
+
+    // Next event if it is due at time now_ms, NULL otherwise
+    SessionEvent const* poll(uint32_t now_ms);
+    SessionEvent const* peek() const { return next < count ? &events[next] : NULL; }
+    void skip() { next++; }
+    bool done() const { return next >= count; }
+    void close();
+
+private:
+    void* base;
+    size_t length;
+    SessionEvent const* events;
+    size_t count, next;
+};
+
+#endif
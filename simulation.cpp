@@ -0,0 +1,490 @@
+#include "simulation.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+Simulation::Simulation()
+    : grid_cols(1), grid_rows(1), grid_min_discs(NUM_DISCS), grid_max_discs(NUM_DISCS),
+      pipeline_depth(1), variant(V_CLASSIC), compress_moves(0), clock(NULL), FPS(60), prev_time(0), ticks(0),
+      on_move(NULL), on_move_context(NULL)
+{
+}
+
+void initialize_simulation(Simulation& sim)
+{
+    //Laying out the grid of independent boards around the origin
+    size_t count = sim.grid_cols * sim.grid_rows;
+    sim.puzzles.clear();
+    sim.puzzles.resize(count);
+    sim.ticks = 0;
+    size_t limit = variant_max_discs(sim.variant);
+    sim.grid_max_discs = min(sim.grid_max_discs, limit);
+    sim.grid_min_discs = min(sim.grid_min_discs, sim.grid_max_discs);
+
+    double width = sim.grid_cols * GRID_SPACING_X;
+    double depth = sim.grid_rows * GRID_SPACING_Z;
+
+    size_t span = sim.grid_max_discs - sim.grid_min_discs + 1;
+    size_t total = 0;
+    for (size_t k = 0; k < count; k++)
+    {
+        sim.puzzles[k].disc_base = total;
+        total += sim.grid_min_discs + k % span;
+    }
+    sim.discs.resize(total);
+
+    for (size_t k = 0; k < count; k++)
+    {
+        Puzzle& p = sim.puzzles[k];
+        initialize_puzzle(sim, p, sim.grid_min_discs + k % span);
+        p.verbose = (count == 1);
+        p.origin.x = ((k % sim.grid_cols) + 0.5) * GRID_SPACING_X - width / 2.0;
+        p.origin.y = 0.0;
+        p.origin.z = ((k / sim.grid_cols) + 0.5) * GRID_SPACING_Z - depth / 2.0;
+        p.start_delay = (k * 7) % 60;
+    }
+}
+
+void initialize_puzzle(Simulation& sim, Puzzle& p, size_t num_discs)
+{
+    //Initializing 1)GameBoard board 2) Discs discs  3) Discs in flight
+    // State
+    GameBoard& t_board = p.board;
+    p.num_discs = num_discs;
+    p.variant = sim.variant;
+    p.sol = SolutionCursor();
+    p.to_solve = false;
+
+    //1) Initializing GameBoard
+    t_board.axis_base_rad = 1.0;
+    t_board.x_min = 0.0;
+    t_board.x_max = 10 * t_board.axis_base_rad;
+    t_board.y_min = 0.0;
+    t_board.y_max = 3 * t_board.axis_base_rad;
+    t_board.disc_height = min(0.3, (AXIS_HEIGHT - 0.3) / num_discs);
+
+    double x_center = 0;
+    double y_center = 0;
+    double dx = (t_board.x_max - t_board.x_min) / 3.0; //Since 3 Axis
+//    double r = t_board.axis_base_rad;
+
+    //Initializing axis Occupancy value, filled with the discs below
+    for (size_t i = 0; i < 3; i++)
+        t_board.axis[i].occupancy_val.resize(num_discs);
+
+    //Initializing Axis positions
+    for (size_t i = 0; i < 3; i++)
+    {
+        t_board.axis[i].positions.resize(num_discs);
+        for (size_t h = 0; h < num_discs; h++)
+        {
+            double x = x_center + ((int)i - 1) * dx;
+            double y = y_center;
+            double z = (h + 1) * t_board.disc_height;
+            CustomPoint& pos_to_set = t_board.axis[i].positions[h];
+            pos_to_set.x = x;
+            pos_to_set.y = y;
+            pos_to_set.z = z;
+        }
+    }
+
+    //2) Initializing Discs, their slots in sim.discs are allocated by initialize_simulation
+    uint8_t pos[MAX_DISCS];
+    for (size_t i = 0; i < num_discs; i++)
+        pos[i] = variant_start_axis(p.variant, i);
+    //3) No disc in flight
+    set_puzzle_state(sim, p, pos);
+}
+
+//Updates the board right away and puts the disc in flight, the animation follows later
+bool move_disc(Puzzle& p, int from_axis, int to_axis)
+{
+    GameBoard& t_board = p.board;
+    ActiveDisc active_disc;
+    int n = p.num_discs;
+
+    int d = to_axis - from_axis;
+    if (d > 0) active_disc.direction = 1;
+    else if (d < 0) active_disc.direction = -1;
+
+    if ((from_axis == to_axis) || (from_axis < 0) || (to_axis < 0) || (from_axis > 2) || (to_axis > 2))
+        return false;
+
+    int i;
+    for (i = n - 1; i >= 0 && t_board.axis[from_axis].occupancy_val[i] < 0; i--);
+    if (i < 0)
+        return false; //No occupied slot => it's an empty Axis
+
+    active_disc.start_pos = t_board.axis[from_axis].positions[i];
+
+    active_disc.disc_index = t_board.axis[from_axis].occupancy_val[i];
+    active_disc.from_axis = from_axis;
+    active_disc.to_axis = to_axis;
+    active_disc.phase = PHASE_LIFT;
+    active_disc.u = 0.0;
+    active_disc.step_u = 0.025;
+
+
+    int j;
+    for (j = 0; j < n - 1 && t_board.axis[to_axis].occupancy_val[j] >= 0; j++);
+    active_disc.dest_pos = t_board.axis[to_axis].positions[j];
+
+    t_board.axis[from_axis].occupancy_val[i] = -1;
+    t_board.axis[to_axis].occupancy_val[j] = active_disc.disc_index;
+    p.active_discs.push_back(active_disc);
+    return true;
+}
+
+CustomPoint get_inerpolated_coordinate(GameBoard const& board, CustomPoint sp, CustomPoint tp, double u)
+{
+    //4 Control points
+    CustomPoint p;
+    double x_center = 0;
+    double y_center = 0;
+
+    double u3 = u * u * u;
+    double u2 = u * u;
+
+    CustomPoint cps[4]; //P1, P2, dP1, dP2
+
+
+    //Hermite Interpolation [Check Reference for equation of spline]
+    {
+        //P1
+        cps[0].x = sp.x;
+        cps[0].y = y_center;
+        cps[0].z = AXIS_HEIGHT + 0.2 * (board.axis_base_rad);
+
+        //P2
+        cps[1].x = tp.x;
+        cps[1].y = y_center;
+        cps[1].z = AXIS_HEIGHT + 0.2 * (board.axis_base_rad);
+
+        //dP1
+        cps[2].x = (sp.x + tp.x) / 2.0 - sp.x;
+        cps[2].y = y_center;
+        cps[2].z = 2 * cps[1].z; //change 2 * ..
+
+        //dP2
+        cps[3].x = tp.x - (tp.x + sp.x) / 2.0;
+        cps[3].y = y_center;
+        cps[3].z = -cps[2].z; //- cps[2].z;
+
+
+        double h0 = 2 * u3 - 3 * u2 + 1;
+        double h1 = -2 * u3 + 3 * u2;
+        double h2 = u3 - 2 * u2 + u;
+        double h3 = u3 - u2;
+
+        p.x = h0 * cps[0].x + h1 * cps[1].x + h2 * cps[2].x + h3 * cps[3].x;
+        p.y = h0 * cps[0].y + h1 * cps[1].y + h2 * cps[2].y + h3 * cps[3].y;
+        p.z = h0 * cps[0].z + h1 * cps[1].z + h2 * cps[2].z + h3 * cps[3].z;
+
+    }
+
+    return p;
+}
+
+//Sets the normal of disc slot s to the normalized (x, y, z)
+void set_normal(DiscArrays& d, size_t s, float x, float y, float z)
+{
+    float length = sqrt(x * x + y * y + z * z);
+    if (length == 0.0f) return;
+    d.nx[s] = x / length;
+    d.ny[s] = y / length;
+    d.nz[s] = z / length;
+}
+
+//A move may start while others are in flight unless one of its axis is still in use:
+//a disc has yet to land there, or a disc is still rising out of that axis
+bool can_start_move(Simulation const& sim, Puzzle const& p, int from_axis, int to_axis)
+{
+    if (p.active_discs.size() >= sim.pipeline_depth)
+        return false;
+    for (size_t a = 0; a < p.active_discs.size(); a++)
+    {
+        ActiveDisc const& ad = p.active_discs[a];
+        if (ad.to_axis == from_axis || ad.to_axis == to_axis)
+            return false;
+        if (ad.phase == PHASE_LIFT && (ad.from_axis == from_axis || ad.from_axis == to_axis))
+            return false;
+    }
+    return true;
+}
+
+//Advances one disc in flight by a tick, returns true once it has landed
+bool step_disc(Simulation& sim, Puzzle& p, ActiveDisc& ad)
+{
+    size_t s = p.disc_base + ad.disc_index;
+    float& z = sim.discs.pz[s];
+    float lift_z = AXIS_HEIGHT + 0.2 * (p.board.axis_base_rad);
+    float lift_step = (sim.pipeline_depth > 1) ? 0.15f : 0.05f;
+
+    if (ad.phase == PHASE_LIFT)
+    {
+        if (z < lift_z) {
+            z += lift_step;
+            return false;
+        }
+        ad.phase = PHASE_FLIGHT;
+    }
+
+    if (ad.phase == PHASE_FLIGHT)
+    {
+        ad.u += ad.step_u;
+        if (ad.u > 1.0) {
+            ad.u = 1.0;
+        }
+
+        CustomPoint pos = get_inerpolated_coordinate(p.board, ad.start_pos, ad.dest_pos, ad.u);
+        set_normal(sim.discs, s, pos.x - sim.discs.px[s], pos.y - sim.discs.py[s], pos.z - z);
+        sim.discs.px[s] = pos.x;
+        sim.discs.py[s] = pos.y;
+        z = pos.z;
+
+        if (ad.u >= 1.0)
+            ad.phase = PHASE_DROP;
+        return false;
+    }
+
+    sim.discs.nx[s] = 0.0f;
+    sim.discs.ny[s] = 0.0f;
+    sim.discs.nz[s] = 1.0f;
+    if (z > ad.dest_pos.z) {
+        z -= lift_step;
+        return false;
+    }
+    z = ad.dest_pos.z;
+    return true;
+}
+
+//True while every disc of a board is where its variant starts it
+static bool at_start(Puzzle const& p)
+{
+    uint8_t pos[MAX_DISCS];
+    board_positions(p, pos);
+    for (size_t i = 0; i < p.num_discs; i++)
+        if (pos[i] != variant_start_axis(p.variant, i))
+            return false;
+    return true;
+}
+
+//Starts solving a board whose discs are all still where they started
+bool start_solve(Simulation& sim, Puzzle& p)
+{
+    if (p.to_solve || !at_start(p))
+        return false;
+    p.sol = SolutionCursor(&sim.solutions, variant_stack(sim.solutions, p.variant, p.num_discs));
+    p.to_solve = !p.sol.empty();
+    return true;
+}
+
+//True when the next moves of a board form a sub-tower that skip_transfers applies at once
+static bool transfer_due(Simulation& sim, Puzzle const& p)
+{
+    return sim.compress_moves >= 2 && p.to_solve &&
+           sim.solutions.length(p.sol.front_transfer(sim.compress_moves)) >= 2;
+}
+
+//Advances the solver and the discs in flight of one board by a tick, returns true if it has to be redrawn
+bool step_puzzle(Simulation& sim, Puzzle& p)
+{
+    if (p.to_solve && p.start_delay > 0) {
+        p.start_delay--;
+        return false;
+    }
+
+    bool skipped = skip_transfers(sim, p);
+
+    //Moves are started in solution order, overlapping as far as the axis allow.
+    //A sub-tower that compressed playback applies at once waits for the discs in flight
+    while (p.to_solve && can_start_move(sim, p, p.sol.front().f, p.sol.front().t) &&
+           (p.active_discs.empty() || !transfer_due(sim, p))) {
+        solution_pair s = p.sol.front();
+        p.sol.pop_front();
+        move_disc(p, s.f, s.t);
+        if (sim.on_move)
+            sim.on_move(sim.on_move_context, &p - &sim.puzzles[0], s.f, s.t, 1);
+        if (p.sol.empty())
+            p.to_solve = false;
+    }
+
+    if (p.active_discs.empty())
+        return skipped;
+
+    for (size_t a = 0; a < p.active_discs.size();)
+    {
+        if (step_disc(sim, p, p.active_discs[a]))
+            p.active_discs.erase(p.active_discs.begin() + a);
+        else a++;
+    }
+    return true;
+}
+
+bool skip_transfers(Simulation& sim, Puzzle& p)
+{
+    if (sim.compress_moves < 2 || !p.active_discs.empty())
+        return false;
+
+    bool skipped = false;
+    uint64_t budget = sim.compress_moves;
+    while (p.to_solve && budget >= 2)
+    {
+        //Single moves are left to the animation, they show the progress of the larger discs
+        SolutionGrammar::symbol block = p.sol.front_transfer(budget);
+        uint64_t length = sim.solutions.length(block);
+        if (length < 2)
+            break;
+
+        size_t m = sim.solutions.transfer_discs(block);
+        solution_pair axes = sim.solutions.transfer_axes(block);
+        vector<int>& from = p.board.axis[axes.f].occupancy_val;
+        vector<int>& to = p.board.axis[axes.t].occupancy_val;
+        int hf = p.num_discs, ht = 0;
+        while (hf > 0 && from[hf - 1] < 0) hf--;
+        while (ht < (int)p.num_discs && to[ht] >= 0) ht++;
+        if (hf < (int)m)
+            break;
+
+        //The tower keeps its order, except that a double tower transfer moves its
+        //largest pair once, which swaps the two colours
+        int base = hf - m;
+        if (variant_paired(p.variant) && m >= 2 &&
+            variant_disc_size(p.variant, from[base]) == variant_disc_size(p.variant, from[base + 1]))
+            swap(from[base], from[base + 1]);
+
+        for (size_t h = 0; h < m; h++)
+        {
+            int d = from[base + h];
+            from[base + h] = -1;
+            to[ht + h] = d;
+
+            size_t s = p.disc_base + d;
+            CustomPoint const& c = p.board.axis[axes.t].positions[ht + h];
+            sim.discs.px[s] = c.x;
+            sim.discs.py[s] = c.y;
+            sim.discs.pz[s] = c.z;
+            sim.discs.nx[s] = 0.0f;
+            sim.discs.ny[s] = 0.0f;
+            sim.discs.nz[s] = 1.0f;
+        }
+
+        p.sol.skip_front(block);
+        if (sim.on_move)
+            sim.on_move(sim.on_move_context, &p - &sim.puzzles[0], axes.f, axes.t, m);
+        if (p.sol.empty())
+            p.to_solve = false;
+        budget -= length;
+        skipped = true;
+    }
+    return skipped;
+}
+
+bool step_simulation(Simulation& sim)
+{
+    bool moved = false;
+    for (size_t k = 0; k < sim.puzzles.size(); k++)
+        moved |= step_puzzle(sim, sim.puzzles[k]);
+    sim.ticks++;
+    return moved;
+}
+
+bool tick_due(Simulation& sim)
+{
+    uint32_t now = sim.clock->now_ms();
+    if (now - sim.prev_time < 1000 / sim.FPS)
+        return false;
+    sim.prev_time = now;
+    return true;
+}
+
+bool simulation_busy(Simulation const& sim)
+{
+    for (size_t k = 0; k < sim.puzzles.size(); k++)
+        if (sim.puzzles[k].to_solve || !sim.puzzles[k].active_discs.empty())
+            return true;
+    return false;
+}
+
+void set_puzzle_state(Simulation& sim, Puzzle& p, const uint8_t* pos, uint32_t swapped)
+{
+    GameBoard& t_board = p.board;
+    size_t height[3] = { 0, 0, 0 };
+    for (size_t a = 0; a < 3; a++)
+        for (size_t h = 0; h < p.num_discs; h++)
+            t_board.axis[a].occupancy_val[h] = -1;
+
+    //Largest disc first, so every axis is filled bottom up
+    for (int j = p.num_discs - 1; j >= 0; j--)
+    {
+        //A swapped pair on one axis is placed smaller index first
+        int i = j;
+        if (variant_paired(p.variant) && (swapped >> (j / 2) & 1) && (j ^ 1) < (int)p.num_discs && pos[j] == pos[j ^ 1])
+            i = j ^ 1;
+        int a = pos[i];
+        size_t h = height[a]++;
+        t_board.axis[a].occupancy_val[h] = i;
+
+        size_t s = p.disc_base + i;
+        CustomPoint const& c = t_board.axis[a].positions[h];
+        sim.discs.px[s] = c.x;
+        sim.discs.py[s] = c.y;
+        sim.discs.pz[s] = c.z;
+        sim.discs.nx[s] = 0.0f;
+        sim.discs.ny[s] = 0.0f;
+        sim.discs.nz[s] = 1.0f;
+    }
+    p.active_discs.clear();
+}
+
+//Top disc of an axis, -1 if it is empty
+int top_disc(Puzzle const& p, int axis)
+{
+    vector<int> const& occ = p.board.axis[axis].occupancy_val;
+    for (int h = p.num_discs - 1; h >= 0; h--)
+        if (occ[h] >= 0) return occ[h];
+    return -1;
+}
+
+//Axis of every disc, as used by the hint engine
+void board_positions(Puzzle const& p, uint8_t* pos)
+{
+    for (int i = 0; i < 3; i++)
+        for (size_t h = 0; h < p.num_discs; h++)
+            if (p.board.axis[i].occupancy_val[h] >= 0)
+                pos[p.board.axis[i].occupancy_val[h]] = i;
+}
+
+uint32_t swapped_pairs(Puzzle const& p)
+{
+    uint32_t swapped = 0;
+    if (!variant_paired(p.variant))
+        return 0;
+    for (int i = 0; i < 3; i++)
+    {
+        vector<int> const& occ = p.board.axis[i].occupancy_val;
+        for (size_t h = 0; h + 1 < p.num_discs && occ[h + 1] >= 0; h++)
+            if (occ[h] % 2 == 0 && occ[h + 1] == occ[h] + 1)
+                swapped |= (uint32_t)1 << (occ[h] / 2);
+    }
+    return swapped;
+}
+
+//Ring radius of disc i: steps of 0.2 up to 7 discs, then spread over [0.2, 1.4]
+double disc_radius(Puzzle const& p, size_t i)
+{
+    double factor;
+    size_t size = variant_disc_size(p.variant, i);
+    size_t sizes = variant_size_count(p.variant, p.num_discs);
+    if (sizes <= 7) factor = 0.2 * (size + 1);
+    else factor = 0.2 + 1.2 * size / (sizes - 1);
+    return factor * p.board.axis_base_rad;
+}
+
+//Tube radius of the discs of a board, thinner as more discs share the axis height
+double disc_tube(Puzzle const& p)
+{
+    return 0.2 * p.board.axis_base_rad * p.board.disc_height / 0.3;
+}
@@ -0,0 +1,194 @@
+#ifndef HANOI_SIMULATION_H
+#define HANOI_SIMULATION_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "solution.h"
+
+// Simulation core: boards, move engine and animator, without GLUT or GL.
+// All state lives in a Simulation object and time comes from the clock it is
+// given, so the same code runs behind the window, in the benchmarks and in
+// headless tools stepping a virtual clock as fast as the CPU allows.
+
+class CustomPoint {
+public:
+    double x;
+    double y;
+    double z;
+    CustomPoint()
+    {
+        x = 0.0;
+        y = 0.0;
+        z = 0.0;
+    }
+    CustomPoint(double Set_X, double Set_Y, double Set_Z)
+    {
+        x = Set_X;
+        y = Set_Y;
+        z = Set_Z;
+    }
+    CustomPoint operator-(CustomPoint const& p1) const
+    {
+        return CustomPoint(x - p1.x, y - p1.y, z - p1.z);
+    }
+};
+
+//Disc kinematics of every board as contiguous float arrays (struct of arrays),
+//updated in place by the simulation and read as is by the renderer
+struct DiscArrays {
+    std::vector<float> px, py, pz;   // position
+    std::vector<float> nx, ny, nz;   // normal = orientation
+
+    void resize(size_t n)
+    {
+        px.assign(n, 0.0f);
+        py.assign(n, 0.0f);
+        pz.assign(n, 0.0f);
+        nx.assign(n, 0.0f);
+        ny.assign(n, 0.0f);
+        nz.assign(n, 1.0f);
+    }
+};
+
+enum DISC_PHASE
+{
+    PHASE_LIFT,        // Rising along the source axis
+    PHASE_FLIGHT,      // Following the spline between the axis
+    PHASE_DROP         // Falling along the destination axis
+};
+
+struct ActiveDisc {    //Active Disc to be moved [later in motion]
+    int disc_index;
+    int from_axis, to_axis;
+    CustomPoint start_pos, dest_pos;
+    double u;		    // u E [0, 1]
+    double step_u;
+    int phase;
+    int direction;     // +1 for Left to Right & -1 for Right to left, 0 = stationary
+};
+
+// Axis and Discs Globals - Can be changed for different levels
+const size_t NUM_DISCS = 6;     // Default disc count of a board
+const size_t MAX_DISCS = 64;
+const double AXIS_HEIGHT = 3.0;
+
+struct Axis {
+    std::vector<CustomPoint> positions;
+    std::vector<int> occupancy_val;
+};
+
+struct GameBoard {
+    double x_min, y_min, x_max, y_max; //Base in XY-Plane
+    double axis_base_rad;               //Axis's base radius
+    double disc_height;                 //Vertical spacing of stacked discs
+    Axis axis[3];
+};
+
+struct Puzzle {        //One independent board of the grid
+    size_t num_discs;
+    int variant;           // HANOI_VARIANT whose rules the board follows
+    GameBoard board;
+    size_t disc_base;      // Index of the first disc of the board in Simulation::discs
+    std::vector<ActiveDisc> active_discs;   // Discs in flight, oldest first
+    SolutionCursor sol;    // Remaining moves, expanded lazily from the grammar
+    bool to_solve;
+    bool verbose;          // Print the moves to the console
+    CustomPoint origin;    // World position of the board centre
+    size_t start_delay;    // Ticks to wait before solving, staggers the animation phase of the boards
+};
+
+//Grid layout
+const double GRID_SPACING_X = 12.0;
+const double GRID_SPACING_Z = 6.0;
+const double BOARD_BOUNDING_RAD = 6.5;   // Bounding sphere of a board: axis, largest disc and its flight arc
+
+//Pipelined animation: how many discs of a board may be in flight at once
+const size_t PIPELINE_DEPTH = 4;
+
+// Source of time in milliseconds, the front end reads GLUT and tools inject their own
+class SimClock {
+public:
+    virtual ~SimClock() {}
+    virtual uint32_t now_ms() const = 0;
+};
+
+// Clock that only moves when told to, for deterministic headless runs
+class VirtualClock : public SimClock {
+public:
+    VirtualClock() : time(0) {}
+    uint32_t now_ms() const { return time; }
+    void advance(uint32_t ms) { time += ms; }
+
+private:
+    uint32_t time;
+};
+
+// Called for every move the solver starts, after the board has been updated.
+// discs is 1, or the size of a sub-tower compressed playback moved from f to t at once
+typedef void (*MoveObserver)(void* context, size_t board, size_t f, size_t t, size_t discs);
+
+struct Simulation {
+    std::vector<Puzzle> puzzles;
+    SolutionGrammar solutions;     // Shared by every board, equal sub-towers are stored once
+    DiscArrays discs;
+
+    size_t grid_cols, grid_rows;
+    size_t grid_min_discs, grid_max_discs;
+    size_t pipeline_depth;
+    int variant;           // HANOI_VARIANT of every board, the disc counts are clamped to its limit
+    uint64_t compress_moves;   // Tower transfers of up to this many moves take one tick, 0 animates every move
+
+    SimClock* clock;       // Must be set before tick_due is used
+    size_t FPS;            // Ticks per second of clock time
+    uint32_t prev_time;    // Clock time of the last tick
+    uint64_t ticks;        // Ticks run since initialize_simulation
+
+    MoveObserver on_move;
+    void* on_move_context;
+
+    Simulation();
+};
+
+// Lays out the grid and puts every board in its start state
+void initialize_simulation(Simulation& sim);
+void initialize_puzzle(Simulation& sim, Puzzle& p, size_t num_discs);
+
+// Starts solving a board whose discs are all still where its variant starts
+// them, false otherwise
+bool start_solve(Simulation& sim, Puzzle& p);
+
+bool move_disc(Puzzle& p, int from_axis, int to_axis);
+bool can_start_move(Simulation const& sim, Puzzle const& p, int from_axis, int to_axis);
+CustomPoint get_inerpolated_coordinate(GameBoard const& board, CustomPoint sp, CustomPoint tp, double u);
+void set_normal(DiscArrays& d, size_t s, float x, float y, float z);
+bool step_disc(Simulation& sim, Puzzle& p, ActiveDisc& ad);
+bool step_puzzle(Simulation& sim, Puzzle& p);
+// Compressed playback: applies the tower transfers at the front of the
+// solution, up to sim.compress_moves moves, while no disc is in flight; with
+// a pipeline the moves before a transfer land first. Each transfer is
+// reported to on_move once. O(depth + discs) whatever its length, false if none fitted
+bool skip_transfers(Simulation& sim, Puzzle& p);
+
+// One tick of every board, returns true if anything moved
+bool step_simulation(Simulation& sim);
+// True once 1000 / FPS ms of clock time have passed since the last tick, which it then marks as now
+bool tick_due(Simulation& sim);
+// True while some board is solving or has discs in flight
+bool simulation_busy(Simulation const& sim);
+
+// Puts the discs of a board at rest in state pos (axis of every disc, one row
+// of hanoi_states_batch). The two discs of a size of a paired variant are stacked
+// with the higher index lower, unless bit j of swapped is set for pair 2j, 2j + 1.
+// Nothing is in flight afterwards, the solver is left as is
+void set_puzzle_state(Simulation& sim, Puzzle& p, const uint8_t* pos, uint32_t swapped = 0);
+
+//Board queries
+int top_disc(Puzzle const& p, int axis);
+void board_positions(Puzzle const& p, uint8_t* pos);
+uint32_t swapped_pairs(Puzzle const& p);         // Pairs of a paired variant with disc 2j under disc 2j + 1
+double disc_radius(Puzzle const& p, size_t i);   // Equal for the two discs of a size of a paired variant
+double disc_tube(Puzzle const& p);
+
+#endif
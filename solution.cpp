@@ -0,0 +1,909 @@
+#include "solution.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HANOI_X86 1
+#endif
+
+using namespace std;
+
+const size_t SolutionGrammar::MAX_PEGS;
+const SolutionGrammar::symbol SolutionGrammar::NUM_TERMINALS;
+const SolutionGrammar::symbol SolutionGrammar::EMPTY;
+
+static const char SLP_MAGIC[4] = { 'H', 'S', 'L', 'P' };
+static const unsigned char SLP_VERSION = 1;
+
+static void put_varint(string& out, uint64_t v)
+{
+    while (v >= 0x80) {
+        out.push_back((char)(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back((char)v);
+}
+
+static bool get_varint(string const& in, size_t& at, uint64_t& v)
+{
+    v = 0;
+    for (int shift = 0; shift < 64 && at < in.size(); shift += 7)
+    {
+        unsigned char c = in[at++];
+        v |= (uint64_t)(c & 0x7f) << shift;
+        if (!(c & 0x80)) return true;
+    }
+    return false;
+}
+
+solution_pair SolutionGrammar::move(symbol s) const
+{
+    solution_pair m;
+    m.f = s / MAX_PEGS;
+    m.t = s % MAX_PEGS;
+    return m;
+}
+
+SolutionGrammar::symbol SolutionGrammar::concat(symbol a, symbol b)
+{
+    if (a == EMPTY) return b;
+    if (b == EMPTY) return a;
+
+    pair<symbol, symbol> key(a, b);
+    map<pair<symbol, symbol>, symbol>::const_iterator it = index.find(key);
+    if (it != index.end())
+        return it->second;
+
+    // Lengths are kept in 64 bits, enough for the 2^64 - 1 moves of 64 discs
+    Rule r;
+    r.left = a;
+    r.right = b;
+    r.length = length(a) + length(b);
+    r.depth = max(depth(a), depth(b)) + 1;
+    r.discs = r.from = r.to = 0;
+    rules.push_back(r);
+
+    symbol s = NUM_TERMINALS + rules.size() - 1;
+    index[key] = s;
+    return s;
+}
+
+SolutionGrammar::symbol SolutionGrammar::from_moves(vector<solution_pair> const& moves)
+{
+    if (moves.empty())
+        return EMPTY;
+
+    vector<symbol> level(moves.size());
+    for (size_t i = 0; i < moves.size(); i++)
+        level[i] = terminal(moves[i].f, moves[i].t);
+
+    // Pairing neighbours level by level keeps the depth logarithmic, and the
+    // hash-consing in concat turns repeated blocks into shared rules
+    while (level.size() > 1)
+    {
+        size_t half = 0;
+        for (size_t i = 0; i < level.size(); i += 2)
+            level[half++] = (i + 1 < level.size()) ? concat(level[i], level[i + 1]) : level[i];
+        level.resize(half);
+    }
+    return level[0];
+}
+
+uint64_t SolutionGrammar::length(symbol s) const
+{
+    if (s == EMPTY) return 0;
+    return is_terminal(s) ? 1 : rule(s).length;
+}
+
+size_t SolutionGrammar::depth(symbol s) const
+{
+    if (s == EMPTY || is_terminal(s)) return 0;
+    return rule(s).depth;
+}
+
+solution_pair SolutionGrammar::at(symbol s, uint64_t k) const
+{
+    while (!is_terminal(s))
+    {
+        Rule const& r = rule(s);
+        uint64_t l = length(r.left);
+        if (k < l) {
+            s = r.left;
+        } else {
+            k -= l;
+            s = r.right;
+        }
+    }
+    return move(s);
+}
+
+void SolutionGrammar::mark_transfer(symbol s, size_t discs, size_t f, size_t t)
+{
+    if (s == EMPTY || is_terminal(s))
+        return;
+    Rule& r = rules[s - NUM_TERMINALS];
+    r.discs = discs;
+    r.from = f;
+    r.to = t;
+}
+
+size_t SolutionGrammar::transfer_discs(symbol s) const
+{
+    if (s == EMPTY) return 0;
+    return is_terminal(s) ? 1 : rule(s).discs;
+}
+
+solution_pair SolutionGrammar::transfer_axes(symbol s) const
+{
+    if (is_terminal(s))
+        return move(s);
+    solution_pair m;
+    m.f = rule(s).from;
+    m.t = rule(s).to;
+    return m;
+}
+
+void SolutionGrammar::serialize(symbol root, string& out) const
+{
+    // Children always precede their rule, so one backward sweep finds the
+    // reachable rules and a forward one numbers them densely
+    vector<symbol> renumber(rules.size(), EMPTY);
+    vector<char> used(rules.size(), 0);
+    if (root != EMPTY && !is_terminal(root))
+        used[root - NUM_TERMINALS] = 1;
+    for (size_t i = rules.size(); i-- > 0;)
+    {
+        if (!used[i]) continue;
+        if (!is_terminal(rules[i].left)) used[rules[i].left - NUM_TERMINALS] = 1;
+        if (!is_terminal(rules[i].right)) used[rules[i].right - NUM_TERMINALS] = 1;
+    }
+
+    size_t count = 0;
+    for (size_t i = 0; i < rules.size(); i++)
+        if (used[i]) renumber[i] = NUM_TERMINALS + count++;
+
+    out.append(SLP_MAGIC, sizeof(SLP_MAGIC));
+    out.push_back((char)SLP_VERSION);
+    put_varint(out, count);
+    for (size_t i = 0; i < rules.size(); i++)
+    {
+        if (!used[i]) continue;
+        symbol l = rules[i].left, r = rules[i].right;
+        put_varint(out, is_terminal(l) ? l : renumber[l - NUM_TERMINALS]);
+        put_varint(out, is_terminal(r) ? r : renumber[r - NUM_TERMINALS]);
+    }
+    if (root == EMPTY || is_terminal(root)) put_varint(out, root);
+    else put_varint(out, renumber[root - NUM_TERMINALS]);
+}
+
+bool SolutionGrammar::deserialize(string const& in, symbol& root)
+{
+    size_t at = sizeof(SLP_MAGIC) + 1;
+    if (in.size() < at || in.compare(0, sizeof(SLP_MAGIC), SLP_MAGIC, sizeof(SLP_MAGIC)) != 0 ||
+        (unsigned char)in[sizeof(SLP_MAGIC)] != SLP_VERSION)
+        return false;
+
+    uint64_t count;
+    if (!get_varint(in, at, count) || count > in.size())
+        return false;
+
+    // File symbols are mapped onto this grammar's own ids
+    vector<symbol> local;
+    local.reserve(count);
+    for (uint64_t i = 0; i < count; i++)
+    {
+        uint64_t sym[2];
+        for (int c = 0; c < 2; c++)
+        {
+            if (!get_varint(in, at, sym[c]) || sym[c] >= NUM_TERMINALS + i)
+                return false;
+            if (sym[c] >= NUM_TERMINALS) sym[c] = local[sym[c] - NUM_TERMINALS];
+        }
+        local.push_back(concat(sym[0], sym[1]));
+    }
+
+    uint64_t r;
+    if (!get_varint(in, at, r))
+        return false;
+    if (r == EMPTY || r < NUM_TERMINALS) root = r;
+    else if (r - NUM_TERMINALS < count) root = local[r - NUM_TERMINALS];
+    else return false;
+    return true;
+}
+
+SolutionCursor::SolutionCursor() : g(NULL), pos(0), total(0), front_root(SolutionGrammar::EMPTY)
+{
+    current.f = current.t = 0;
+}
+
+SolutionCursor::SolutionCursor(SolutionGrammar const* grammar, SolutionGrammar::symbol root, uint64_t start)
+    : g(grammar), pos(start), total(grammar->length(root)), front_root(SolutionGrammar::EMPTY)
+{
+    current.f = current.t = 0;
+    if (pos >= total)
+        return;
+
+    pending.reserve(g->depth(root) + 1);
+    SolutionGrammar::symbol s = root;
+    uint64_t k = start;
+    while (!g->is_terminal(s))
+    {
+        // From the first symbol starting right at the move, the path only goes left
+        if (k == 0 && front_root == SolutionGrammar::EMPTY)
+            front_root = s;
+        uint64_t l = g->length(g->left(s));
+        if (k < l) {
+            pending.push_back(g->right(s));
+            s = g->left(s);
+        } else {
+            k -= l;
+            s = g->right(s);
+        }
+    }
+    if (front_root == SolutionGrammar::EMPTY)
+        front_root = s;
+    current = g->move(s);
+}
+
+void SolutionCursor::descend(SolutionGrammar::symbol s)
+{
+    front_root = s;
+    while (!g->is_terminal(s))
+    {
+        pending.push_back(g->right(s));
+        s = g->left(s);
+    }
+    current = g->move(s);
+}
+
+void SolutionCursor::pop_front()
+{
+    if (++pos >= total)
+        return;
+    SolutionGrammar::symbol s = pending.back();
+    pending.pop_back();
+    descend(s);
+}
+
+SolutionGrammar::symbol SolutionCursor::front_transfer(uint64_t max_moves) const
+{
+    if (empty())
+        return SolutionGrammar::EMPTY;
+    for (SolutionGrammar::symbol s = front_root; ; s = g->left(s))
+    {
+        if (g->length(s) <= max_moves && g->transfer_discs(s) > 0)
+            return s;
+        if (g->is_terminal(s))
+            return SolutionGrammar::EMPTY;
+    }
+}
+
+void SolutionCursor::skip_front(SolutionGrammar::symbol block)
+{
+    // The right halves of the spine from block down lie inside it
+    size_t inside = 0;
+    for (SolutionGrammar::symbol s = block; !g->is_terminal(s); s = g->left(s))
+        inside++;
+    pending.resize(pending.size() - inside);
+
+    pos += g->length(block);
+    if (pos >= total)
+        return;
+    SolutionGrammar::symbol s = pending.back();
+    pending.pop_back();
+    descend(s);
+}
+
+uint64_t hanoi_hint(const uint8_t* pos, int n, int target, solution_pair* next)
+{
+    uint64_t distance = 0;
+    int t = target;
+    for (int i = n - 1; i >= 0; i--)
+    {
+        if (pos[i] == t)
+            continue;
+        distance += (uint64_t)1 << i;
+        if (next) {
+            next->f = pos[i];
+            next->t = t;
+        }
+        t = 3 - pos[i] - t;
+    }
+    return distance;
+}
+
+//Axis cycle step of disc i: +2 (0 -> 2 -> 1) when n - i is odd, +1 otherwise
+static inline unsigned disc_step(int n, int i)
+{
+    return ((n - i) & 1) ? 2 : 1;
+}
+
+solution_pair hanoi_kth_move(int n, uint64_t k)
+{
+    // Move m = k + 1 moves disc i = ctz(m) for the (j + 1)-th time
+    uint64_t m = k + 1;
+    int i = __builtin_ctzll(m);
+    uint64_t j = (i < 63) ? m >> (i + 1) : 0;
+    unsigned step = disc_step(n, i);
+
+    solution_pair s;
+    s.f = (j % 3) * step % 3;
+    s.t = (j % 3 + 1) * step % 3;
+    return s;
+}
+
+void hanoi_state_after(int n, uint64_t k, uint8_t* pos)
+{
+    for (int i = 0; i < n; i++)
+    {
+        // floor((k + 2^i) / 2^(i+1)) moves so far, without overflowing at i = 63
+        uint64_t moves = (i < 63 ? k >> (i + 1) : 0) + ((k >> i) & 1);
+        pos[i] = (moves % 3) * disc_step(n, i) % 3;
+    }
+}
+
+//(k >> n) mod 3, the move count residue above the largest disc, 0 for valid k
+static inline unsigned high_residue(int n, uint64_t k)
+{
+    return (n < 64) ? (k >> n) % 3 : 0;
+}
+
+void hanoi_states_batch_scalar(int n, const uint64_t* k, size_t count, uint8_t* out)
+{
+    for (size_t j = 0; j < count; j++)
+    {
+        uint8_t* row = out + j * n;
+        unsigned r = high_residue(n, k[j]);    // floor(k / 2^(i+1)) mod 3
+        for (int i = n - 1; i >= 0; i--)
+        {
+            unsigned b = (k[j] >> i) & 1;
+            row[i] = (r + b) % 3 * disc_step(n, i) % 3;
+            r = (2 * r + b) % 3;
+        }
+    }
+}
+
+#ifdef HANOI_X86
+//x mod 3 of lanes holding at most 5
+__attribute__((target("avx2")))
+static inline __m256i mod3_small(__m256i x)
+{
+    const __m256i two = _mm256_set1_epi64x(2), three = _mm256_set1_epi64x(3);
+    return _mm256_sub_epi64(x, _mm256_and_si256(_mm256_cmpgt_epi64(x, two), three));
+}
+
+//Lane l runs the scalar recurrence for k[j + l]; the axis of 8 discs are
+//packed into one byte each of a lane, then stored as a piece of the row
+__attribute__((target("avx2")))
+static void states_batch_avx2(int n, const uint64_t* k, size_t count, uint8_t* out)
+{
+    const __m256i one = _mm256_set1_epi64x(1);
+    size_t j = 0;
+    for (; j + 4 <= count; j += 4)
+    {
+        __m256i kv = _mm256_loadu_si256((const __m256i*)(k + j));
+        __m256i r = _mm256_set_epi64x(high_residue(n, k[j + 3]), high_residue(n, k[j + 2]),
+                                      high_residue(n, k[j + 1]), high_residue(n, k[j]));
+        __m256i packed = _mm256_setzero_si256();
+        for (int i = n - 1; i >= 0; i--)
+        {
+            __m256i b = _mm256_and_si256(_mm256_srl_epi64(kv, _mm_cvtsi32_si128(i)), one);
+            __m256i axis = mod3_small(_mm256_add_epi64(r, b));
+            if (disc_step(n, i) == 2)
+                axis = mod3_small(_mm256_add_epi64(axis, axis));
+            packed = _mm256_or_si256(packed, _mm256_sll_epi64(axis, _mm_cvtsi32_si128(8 * (i & 7))));
+            r = mod3_small(_mm256_add_epi64(_mm256_add_epi64(r, r), b));
+
+            if ((i & 7) == 0) {
+                uint64_t lanes[4];
+                _mm256_storeu_si256((__m256i*)lanes, packed);
+                size_t bytes = min(8, n - i);
+                for (int l = 0; l < 4; l++)
+                    memcpy(out + (j + l) * n + i, &lanes[l], bytes);
+                packed = _mm256_setzero_si256();
+            }
+        }
+    }
+    hanoi_states_batch_scalar(n, k + j, count - j, out + j * n);
+}
+#endif
+
+void hanoi_states_batch(int n, const uint64_t* k, size_t count, uint8_t* out)
+{
+#ifdef HANOI_X86
+    static const bool avx2 = __builtin_cpu_supports("avx2");
+    if (avx2) {
+        states_batch_avx2(n, k, count, out);
+        return;
+    }
+#endif
+    hanoi_states_batch_scalar(n, k, count, out);
+}
+
+uint64_t hanoi_distance(const uint8_t* a, const uint8_t* b, int n)
+{
+    int k;
+    for (k = n - 1; k >= 0 && a[k] == b[k]; k--);
+    if (k < 0)
+        return 0;
+
+    int r = 3 - a[k] - b[k];
+    uint64_t once = hanoi_hint(a, k, r, NULL) + 1 + hanoi_hint(b, k, r, NULL);
+    uint64_t twice = hanoi_hint(a, k, b[k], NULL) + 1 + (((uint64_t)1 << k) - 1) + 1 + hanoi_hint(b, k, a[k], NULL);
+    return once < twice ? once : twice;
+}
+
+SolutionGrammar::symbol move_stack(SolutionGrammar& g, int n, int f, int t)
+{
+    if (n <= 0 || f == t)
+        return SolutionGrammar::EMPTY;
+
+    // transfer[a][b] holds the current level's a -> b transfer, two n-1 blocks
+    // with relabelled axis around one move of the largest disc
+    SolutionGrammar::symbol transfer[3][3], next[3][3];
+    for (int a = 0; a < 3; a++)
+        for (int b = 0; b < 3; b++)
+            transfer[a][b] = (a == b) ? SolutionGrammar::EMPTY : g.terminal(a, b);
+
+    for (int level = 2; level <= n; level++)
+    {
+        for (int a = 0; a < 3; a++)
+            for (int b = 0; b < 3; b++)
+            {
+                if (a == b) {
+                    next[a][b] = SolutionGrammar::EMPTY;
+                    continue;
+                }
+                int o = 3 - a - b;
+                next[a][b] = g.concat(g.concat(transfer[a][o], g.terminal(a, b)), transfer[o][b]);
+                g.mark_transfer(next[a][b], level, a, b);
+            }
+        for (int a = 0; a < 3; a++)
+            for (int b = 0; b < 3; b++)
+                transfer[a][b] = next[a][b];
+    }
+    return transfer[f][t];
+}
+
+static const char* VARIANT_NAMES[V_COUNT] = { "classic", "cyclic", "adjacent", "double", "bicolor" };
+
+const char* variant_name(int variant)
+{
+    return (variant >= 0 && variant < V_COUNT) ? VARIANT_NAMES[variant] : "?";
+}
+
+int variant_from_name(const char* name)
+{
+    for (int v = 0; v < V_COUNT; v++)
+        if (string(name) == VARIANT_NAMES[v])
+            return v;
+    return -1;
+}
+
+int variant_max_discs(int variant)
+{
+    switch (variant)
+    {
+        case V_CYCLIC: return 44;
+        case V_ADJACENT: return 40;
+        default: return 64;
+    }
+}
+
+bool variant_allows(int variant, int f, int t)
+{
+    if (f == t)
+        return false;
+    switch (variant)
+    {
+        case V_CYCLIC: return t == (f + 1) % 3;
+        case V_ADJACENT: return f == 1 || t == 1;
+        default: return true;
+    }
+}
+
+int variant_disc_size(int variant, int i)
+{
+    return variant_paired(variant) ? i / 2 : i;
+}
+
+int variant_size_count(int variant, int n)
+{
+    return variant_paired(variant) ? (n + 1) / 2 : n;
+}
+
+bool variant_paired(int variant)
+{
+    return variant == V_DOUBLE || variant == V_BICOLOR;
+}
+
+int variant_start_axis(int variant, int i)
+{
+    return (variant == V_BICOLOR) ? i % 2 : 0;
+}
+
+int variant_disc_colour(int variant, int i)
+{
+    return (variant == V_BICOLOR) ? (i / 2 + i) % 2 : i;
+}
+
+static SolutionGrammar::symbol cyclic_stack(SolutionGrammar& g, int n)
+{
+    // q[a], r[a]: the current level's transfers from axis a one and two steps clockwise
+    SolutionGrammar::symbol q[3], r[3], nq[3], nr[3];
+    for (int a = 0; a < 3; a++)
+        q[a] = r[a] = SolutionGrammar::EMPTY;
+
+    for (int level = 1; level <= n; level++)
+    {
+        for (int a = 0; a < 3; a++)
+        {
+            int a1 = (a + 1) % 3, a2 = (a + 2) % 3;
+            nq[a] = g.concat(g.concat(r[a], g.terminal(a, a1)), r[a2]);
+            nr[a] = g.concat(g.concat(g.concat(g.concat(r[a], g.terminal(a, a1)), q[a2]), g.terminal(a1, a2)), r[a]);
+            g.mark_transfer(nq[a], level, a, a1);
+            g.mark_transfer(nr[a], level, a, a2);
+        }
+        for (int a = 0; a < 3; a++)
+        {
+            q[a] = nq[a];
+            r[a] = nr[a];
+        }
+    }
+    return r[0];
+}
+
+static SolutionGrammar::symbol adjacent_stack(SolutionGrammar& g, int n)
+{
+    // x[0]: 0 -> 2 and x[1]: 2 -> 0 at the current level
+    SolutionGrammar::symbol x[2] = { SolutionGrammar::EMPTY, SolutionGrammar::EMPTY }, next[2];
+    for (int level = 1; level <= n; level++)
+    {
+        for (int d = 0; d < 2; d++)
+        {
+            int a = d ? 2 : 0, b = 2 - a;
+            next[d] = g.concat(g.concat(g.concat(g.concat(x[d], g.terminal(a, 1)), x[1 - d]), g.terminal(1, b)), x[d]);
+            g.mark_transfer(next[d], level, a, b);
+        }
+        x[0] = next[0];
+        x[1] = next[1];
+    }
+    return x[0];
+}
+
+// Double tower transfers of one more size from those of the smaller ones: the
+// two discs of the size move between the smaller transfers, which reverses
+// their order. An unpaired size, the largest of an odd n, moves once
+static void double_level(SolutionGrammar& g, SolutionGrammar::symbol const (&transfer)[3][3], bool pair, int discs,
+                         SolutionGrammar::symbol (&next)[3][3])
+{
+    for (int a = 0; a < 3; a++)
+        for (int b = 0; b < 3; b++)
+        {
+            if (a == b) {
+                next[a][b] = SolutionGrammar::EMPTY;
+                continue;
+            }
+            int o = 3 - a - b;
+            SolutionGrammar::symbol move = g.terminal(a, b);
+            if (pair)
+                move = g.concat(move, move);
+            next[a][b] = g.concat(g.concat(transfer[a][o], move), transfer[o][b]);
+            g.mark_transfer(next[a][b], discs, a, b);
+        }
+}
+
+static SolutionGrammar::symbol double_stack(SolutionGrammar& g, int n)
+{
+    SolutionGrammar::symbol transfer[3][3], next[3][3];
+    for (int a = 0; a < 3; a++)
+        for (int b = 0; b < 3; b++)
+            transfer[a][b] = SolutionGrammar::EMPTY;
+
+    int sizes = variant_size_count(V_DOUBLE, n);
+    for (int s = 0; s < sizes; s++)
+    {
+        bool pair = (2 * s + 1 < n);   // An odd n leaves the largest size with one disc
+        double_level(g, transfer, pair, pair ? 2 * s + 2 : 2 * s + 1, next);
+        for (int a = 0; a < 3; a++)
+            for (int b = 0; b < 3; b++)
+                transfer[a][b] = next[a][b];
+    }
+    return transfer[0][2];
+}
+
+// Bicolor towers: pair j is disc 2j, starting on axis 0, and disc 2j + 1 on
+// axis 1. The pairs below the one being worked on travel as a double tower,
+// and top_odd[j] follows which disc of pair j is on top while the two are
+// stacked. A double tower transfer reverses its largest pair, keep_order
+// costs more and does not: split picks between them so the next split finds
+// the bottom disc of its pair on its own tower, or takes the pair off axis 2
+// at once and the smaller pairs back there.
+class BicolorBuilder {
+public:
+    BicolorBuilder(SolutionGrammar& g, int n);
+    SolutionGrammar::symbol solve();
+
+private:
+    typedef SolutionGrammar::symbol symbol;
+    SolutionGrammar& g;
+    int n;
+    int colour;                      // Colour that ends on axis 0
+    vector<symbol> transfers;        // 9 per size count m: the sizes < m from a to b
+    vector<bool> top_odd;
+
+    int dest(int disc) const { return variant_disc_colour(V_BICOLOR, disc) == colour ? 0 : 1; }
+    int top(int j) const { return 2 * j + (top_odd[j] ? 1 : 0); }
+    symbol then(symbol a, symbol b) { return g.concat(a, b); }
+    symbol move(int f, int t) { return g.terminal(f, t); }
+    symbol pair_move(int f, int t) { return g.concat(move(f, t), move(f, t)); }
+
+    symbol tower(int m, int f, int t);
+    symbol keep_order(int m, int f, int t);
+    symbol place(int m, int f, int s);
+    symbol gather(int k, int t);
+    symbol split(int k, int s);
+    symbol swap_pair(int k);
+
+    uint64_t transfer_cost(int m, bool keep);
+    uint64_t split_cost(int k, int s);
+    int split_choice(int k, uint64_t& cost);
+    map<int, uint64_t> split_costs;  // split_cost by k, s and the two pairs below k it may find flipped
+};
+
+BicolorBuilder::BicolorBuilder(SolutionGrammar& g, int n) : g(g), n(n), colour(0)
+{
+    int pairs = n / 2;
+    if (n >= 2)
+        colour = variant_disc_colour(V_BICOLOR, (n % 2) ? n - 1 : n - 2);
+    top_odd.assign(pairs + 1, false);
+
+    SolutionGrammar::symbol transfer[3][3], next[3][3];
+    for (int a = 0; a < 3; a++)
+        for (int b = 0; b < 3; b++)
+            transfer[a][b] = SolutionGrammar::EMPTY;
+    for (int m = 0; ; m++)
+    {
+        for (int a = 0; a < 3; a++)
+            for (int b = 0; b < 3; b++)
+                transfers.push_back(transfer[a][b]);
+        if (m == pairs)
+            break;
+        double_level(g, transfer, true, 2 * m + 2, next);
+        for (int a = 0; a < 3; a++)
+            for (int b = 0; b < 3; b++)
+                transfer[a][b] = next[a][b];
+    }
+}
+
+// Double tower of the sizes < m from f to t, reversing pair m - 1
+SolutionGrammar::symbol BicolorBuilder::tower(int m, int f, int t)
+{
+    if (m == 0)
+        return SolutionGrammar::EMPTY;
+    top_odd[m - 1] = !top_odd[m - 1];
+    return transfers[9 * m + 3 * f + t];
+}
+
+// Same, pair m - 1 keeping its order: it stops on the third axis
+SolutionGrammar::symbol BicolorBuilder::keep_order(int m, int f, int t)
+{
+    int o = 3 - f - t;
+    if (m == 0)
+        return SolutionGrammar::EMPTY;
+    if (m == 1)
+        return then(then(move(f, o), move(f, t)), move(o, t));
+    symbol s = tower(m - 1, f, t);
+    s = then(s, pair_move(f, o));
+    s = then(s, tower(m - 1, t, f));
+    s = then(s, pair_move(o, t));
+    return then(s, tower(m - 1, f, t));
+}
+
+// Double tower of the sizes < m from f onto s (0 or 1), its largest pair
+// landing with the disc of tower s at the bottom
+SolutionGrammar::symbol BicolorBuilder::place(int m, int f, int s)
+{
+    if (m == 0)
+        return SolutionGrammar::EMPTY;
+    return (dest(top(m - 1)) == s) ? tower(m, f, s) : keep_order(m, f, s);
+}
+
+// The sizes < k of both start towers into one double tower on t
+SolutionGrammar::symbol BicolorBuilder::gather(int k, int t)
+{
+    if (k == 0)
+        return SolutionGrammar::EMPTY;
+    symbol s;
+    if (t == 2) {
+        s = gather(k - 1, 1);
+        s = then(s, move(0, 2));
+        s = then(s, tower(k - 1, 1, 0));
+        s = then(s, move(1, 2));
+        s = then(s, tower(k - 1, 0, 2));
+    } else {
+        s = gather(k - 1, 2);
+        s = then(s, move(1 - t, t));
+        s = then(s, tower(k - 1, 2, t));
+    }
+    //The disc of the other tower lands last, except on axis 1 where it is already
+    top_odd[k - 1] = (t != 1);
+    return s;
+}
+
+// Moves of tower (keep false) or keep_order, flipping top_odd the same way
+// without building either
+uint64_t BicolorBuilder::transfer_cost(int m, bool keep)
+{
+    if (m == 0)
+        return 0;
+    if (!keep) {
+        top_odd[m - 1] = !top_odd[m - 1];
+        return ((uint64_t)2 << m) - 2;
+    }
+    if (m == 1)
+        return 3;
+    top_odd[m - 2] = !top_odd[m - 2];
+    return 3 * (((uint64_t)2 << (m - 1)) - 2) + 4;
+}
+
+// Moves of split(k, s) taking the cheaper choice everywhere, top_odd left as
+// found. The choices at size k only flip pairs k - 2 and k - 3, so the pairs
+// below k - 2 are the same on every call for k
+uint64_t BicolorBuilder::split_cost(int k, int s)
+{
+    if (k == 0)
+        return 0;
+    int key = ((k * 3 + s) * 2 + top_odd[k - 1]) * 2 + (k >= 2 && top_odd[k - 2]);
+    map<int, uint64_t>::iterator it = split_costs.find(key);
+    if (it != split_costs.end())
+        return it->second;
+
+    uint64_t best;
+    if (s != 2) {
+        vector<bool> saved = top_odd;
+        best = transfer_cost(k - 1, false) + 1;
+        best += split_cost(k - 1, 2);
+        top_odd = saved;
+    } else {
+        split_choice(k, best);
+    }
+    split_costs[key] = best;
+    return best;
+}
+
+// Which way split(k, 2) goes and at what cost, top_odd left as found: 0 over
+// the top disc, placed to stay, or 1 and 2 under it, the pair going to its
+// axis reversed and tower or keep_order bringing the smaller ones back
+int BicolorBuilder::split_choice(int k, uint64_t& best)
+{
+    vector<bool> saved = top_odd;
+    int p = dest(top(k - 1)), choice = 0;
+    best = transfer_cost(k - 1, false) + 1;
+    best += transfer_cost(k - 1, k >= 2 && dest(top(k - 2)) != p) + 1;
+    best += split_cost(k - 1, p);
+    for (int keep = 0; keep < 2; keep++)
+    {
+        top_odd = saved;
+        uint64_t c = transfer_cost(k - 1, false) + 2;
+        c += transfer_cost(k - 1, keep) + 1;
+        c += split_cost(k - 1, 2);
+        if (c < best) {
+            best = c;
+            choice = 1 + keep;
+        }
+    }
+    top_odd = saved;
+    return choice;
+}
+
+// The double tower of the sizes < k on s into the two colour towers. On axis
+// 0 or 1 the bottom disc of pair k - 1 is already where it belongs
+SolutionGrammar::symbol BicolorBuilder::split(int k, int s)
+{
+    if (k == 0)
+        return SolutionGrammar::EMPTY;
+    symbol r;
+    if (s == 2) {
+        uint64_t cost;
+        int choice = split_choice(k, cost);
+        int p = dest(top(k - 1)), q = 1 - p;
+        r = tower(k - 1, 2, q);
+        if (choice == 0) {
+            r = then(r, move(2, p));
+            r = then(r, place(k - 1, q, p));
+            r = then(r, move(2, q));
+            return then(r, split(k - 1, p));
+        }
+        r = then(r, pair_move(2, p));
+        r = then(r, (choice == 1) ? tower(k - 1, q, 2) : keep_order(k - 1, q, 2));
+        r = then(r, move(p, q));
+        return then(r, split(k - 1, 2));
+    }
+    r = tower(k - 1, s, 2);
+    r = then(r, move(s, 1 - s));
+    return then(r, split(k - 1, 2));
+}
+
+// Exchanges the discs of pair k - 1 between axis 0 and 1 over axis 2, the
+// smaller pairs following as a double tower, then sorts those
+SolutionGrammar::symbol BicolorBuilder::swap_pair(int k)
+{
+    symbol s = gather(k - 1, 1);
+    s = then(s, move(0, 2));
+    s = then(s, tower(k - 1, 1, 2));
+    s = then(s, move(1, 0));
+    s = then(s, place(k - 1, 2, 0));
+    s = then(s, move(2, 1));
+    return then(s, split(k - 1, 0));
+}
+
+// The largest pair stays when its disc on axis 0 has the colour of the bottom
+// one, which holds for an even n, and the pairs alternate from there
+SolutionGrammar::symbol BicolorBuilder::solve()
+{
+    int k = (n - 1) / 2;
+    return (k > 0) ? swap_pair(k) : SolutionGrammar::EMPTY;
+}
+
+SolutionGrammar::symbol variant_stack(SolutionGrammar& g, int variant, int n)
+{
+    if (n <= 0 || n > variant_max_discs(variant))
+        return SolutionGrammar::EMPTY;
+    switch (variant)
+    {
+        case V_CYCLIC: return cyclic_stack(g, n);
+        case V_ADJACENT: return adjacent_stack(g, n);
+        case V_DOUBLE: return double_stack(g, n);
+        case V_BICOLOR: return BicolorBuilder(g, n).solve();
+        default: return move_stack(g, n, 0, 2);
+    }
+}
+
+uint64_t variant_moves(int variant, int n)
+{
+    SolutionGrammar g;
+    return g.length(variant_stack(g, variant, n));
+}
+
+int moves_main(int argc, char** argv)
+{
+    int n = 0, variant = V_CLASSIC;
+    uint64_t start = 0;
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+        if (arg == "--moves" && i + 1 < argc) n = atoi(argv[++i]);
+        else if (arg == "--variant" && i + 1 < argc) variant = variant_from_name(argv[++i]);
+        else if (arg == "--from" && i + 1 < argc) start = strtoull(argv[++i], NULL, 10);
+    }
+    if (variant < 0 || n < 1 || n > variant_max_discs(variant)) {
+        cerr << "Uso: hanoi --moves N [--variant classic|cyclic|adjacent|double|bicolor] [--from K]" << endl;
+        return 1;
+    }
+
+    SolutionGrammar g;
+    SolutionGrammar::symbol root = variant_stack(g, variant, n);
+    if (start > g.length(root))
+        start = g.length(root);
+
+    //Lines are assembled in a buffer, a move costs a few stores and no formatting
+    static char buffer[1 << 16];
+    size_t used = 0;
+    for (SolutionCursor c(&g, root, start); !c.empty(); c.pop_front())
+    {
+        if (used > sizeof(buffer) - 4) {
+            if (fwrite(buffer, 1, used, stdout) != used)
+                return 1;
+            used = 0;
+        }
+        buffer[used++] = '0' + c.front().f;
+        buffer[used++] = ' ';
+        buffer[used++] = '0' + c.front().t;
+        buffer[used++] = '\n';
+    }
+    return fwrite(buffer, 1, used, stdout) == used ? 0 : 1;
+}
@@ -0,0 +1,186 @@
+#ifndef HANOI_SOLUTION_H
+#define HANOI_SOLUTION_H
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+struct solution_pair {
+    size_t f, t;         //f = from, t = to
+};
+
+// Straight-line grammar of move sequences. Every symbol stands for one
+// sequence: the terminals are the single moves f -> t, every other symbol is
+// a rule A B that concatenates two earlier symbols. Rules are hash-consed, so
+// repeated sub-sequences (the (n-1)-disc transfers of the classic solution,
+// repeated blocks of an imported solution) are stored once, and several
+// boards can share one grammar.
+class SolutionGrammar {
+public:
+    typedef uint32_t symbol;
+
+    static const size_t MAX_PEGS = 4;
+    static const symbol NUM_TERMINALS = MAX_PEGS * MAX_PEGS;
+    static const symbol EMPTY = 0xffffffffu;     // The empty sequence
+
+    symbol terminal(size_t f, size_t t) const { return f * MAX_PEGS + t; }
+    bool is_terminal(symbol s) const { return s < NUM_TERMINALS; }
+    solution_pair move(symbol s) const;
+    symbol left(symbol s) const { return rule(s).left; }
+    symbol right(symbol s) const { return rule(s).right; }
+
+    // Sequence a followed by b
+    symbol concat(symbol a, symbol b);
+    // Balanced grammar of an explicit move list, depth O(log N)
+    symbol from_moves(std::vector<solution_pair> const& moves);
+
+    uint64_t length(symbol s) const;
+    size_t depth(symbol s) const;
+    size_t rule_count() const { return rules.size(); }
+
+    // k-th move of sequence s, O(depth(s))
+    solution_pair at(symbol s, uint64_t k) const;
+
+    // Tower transfers: the solvers mark the symbols that move the top discs
+    // of axis f to axis t, so playback can apply them at once instead of move
+    // by move. A terminal is the transfer of one disc, unmarked rules have 0
+    void mark_transfer(symbol s, size_t discs, size_t f, size_t t);
+    size_t transfer_discs(symbol s) const;
+    solution_pair transfer_axes(symbol s) const;
+
+    // Appends the rules reachable from root to out, renumbered, as varints
+    void serialize(symbol root, std::string& out) const;
+    // Reads a grammar written by serialize into this one, false if malformed
+    bool deserialize(std::string const& in, symbol& root);
+
+private:
+    struct Rule {
+        symbol left, right;
+        uint64_t length;
+        uint32_t depth;
+        uint8_t discs, from, to;   // Tower transfer, discs = 0 if not marked
+    };
+    std::vector<Rule> rules;
+    std::map<std::pair<symbol, symbol>, symbol> index;
+
+    Rule const& rule(symbol s) const { return rules[s - NUM_TERMINALS]; }
+};
+
+// Lazy in-order expansion of a grammar symbol. Memory is O(depth), no
+// allocation happens per move.
+class SolutionCursor {
+public:
+    SolutionCursor();
+    SolutionCursor(SolutionGrammar const* grammar, SolutionGrammar::symbol root, uint64_t start = 0);
+
+    bool empty() const { return pos >= total; }
+    uint64_t position() const { return pos; }
+    uint64_t remaining() const { return total - pos; }
+
+    solution_pair front() const { return current; }
+    void pop_front();
+
+    // Largest marked transfer starting at the current move with at most
+    // max_moves moves, EMPTY if there is none. O(depth)
+    SolutionGrammar::symbol front_transfer(uint64_t max_moves) const;
+    // Skips all the moves of a symbol returned by front_transfer
+    void skip_front(SolutionGrammar::symbol block);
+
+private:
+    SolutionGrammar const* g;
+    std::vector<SolutionGrammar::symbol> pending;   // Right halves still to expand
+    solution_pair current;
+    uint64_t pos, total;
+    // Outermost symbol starting at the current move: its left spine ends
+    // there, and the right halves of the spine are the top of pending
+    SolutionGrammar::symbol front_root;
+
+    void descend(SolutionGrammar::symbol s);
+};
+
+// Optimal play from any legal position. pos[i] is the axis of disc i, disc 0
+// being the smallest. Returns the number of moves needed to gather the n discs
+// on axis target, and the first of those moves in next (when it is not 0).
+// Disc by disc from the largest: a disc already on its target keeps the target
+// for the smaller ones, otherwise it costs 2^i moves and the smaller discs must
+// first go to the third axis. The deepest mismatch is the next move. O(n)
+uint64_t hanoi_hint(const uint8_t* pos, int n, int target, solution_pair* next);
+
+// Closed forms of the classic transfer of n <= 64 discs from axis 0 to axis 2.
+// Disc i moves every 2^(i+1) moves starting at move 2^i, always cycling the
+// axis in the same direction: 0 -> 2 -> 1 when n - i is odd, 0 -> 1 -> 2 else.
+solution_pair hanoi_kth_move(int n, uint64_t k);               // k-th move, 0-based, k < 2^n - 1
+void hanoi_state_after(int n, uint64_t k, uint8_t* pos);       // Axis of every disc after k moves
+
+// hanoi_state_after for count move counts at once, into a dense count x n
+// matrix: row j (out + j * n) is the state after k[j] moves, in the layout
+// set_puzzle_state reads. Runs disc by disc from the largest, keeping
+// floor(k / 2^(i+1)) mod 3 per k, which needs one bit of k per disc and no
+// division. Four k per step with AVX2 when the CPU has it.
+void hanoi_states_batch(int n, const uint64_t* k, size_t count, uint8_t* out);
+void hanoi_states_batch_scalar(int n, const uint64_t* k, size_t count, uint8_t* out);
+
+// Fewest moves between two legal positions of n discs, O(n). Only the largest
+// differing disc matters: it moves once, over the third axis holding the
+// smaller discs, or twice, passing them from one tower to the other in
+// between. Bounded by 2^(n+1), so n <= 62.
+uint64_t hanoi_distance(const uint8_t* a, const uint8_t* b, int n);
+
+// Hanoi Algorithem: the optimal transfer of n discs from axis f to axis t,
+// built bottom-up in O(n) rules
+SolutionGrammar::symbol move_stack(SolutionGrammar& g, int n, int f, int t);
+
+// Variants of the puzzle, all solved from axis 0 to axis 2 but bicolor
+enum HANOI_VARIANT
+{
+    V_CLASSIC,         // Any move
+    V_CYCLIC,          // Clockwise only: 0 -> 1 -> 2 -> 0
+    V_ADJACENT,        // No direct move between 0 and 2, 3^n - 1 moves
+    V_DOUBLE,          // Double tower: two discs of each size, discs 2j and 2j + 1 share a size
+    V_BICOLOR,         // Two towers of alternating colours on 0 and 1, sorted into one colour each
+    V_COUNT
+};
+
+const char* variant_name(int variant);
+int variant_from_name(const char* name);       // -1 if unknown
+int variant_max_discs(int variant);            // Largest n whose move count fits in 64 bits
+bool variant_allows(int variant, int f, int t);
+// Size class of disc i of n: discs of equal size may be stacked on each other
+int variant_disc_size(int variant, int i);
+int variant_size_count(int variant, int n);
+// Double and bicolor: discs 2j and 2j + 1 share a size, the order of a stacked pair matters
+bool variant_paired(int variant);
+// Axis of disc i before solving: 0, or its tower of the bicolor start, 0 for
+// even i and 1 for odd i
+int variant_start_axis(int variant, int i);
+// Colour of disc i: bicolor discs are 0 or 1, alternating up each start tower
+// and differing within a pair; the other variants give every disc its own
+int variant_disc_colour(int variant, int i);
+
+// Optimal transfer of n discs from axis 0 to axis 2 under the rules of a
+// variant, built bottom-up in O(n) rules like move_stack, so a SolutionCursor
+// streams it with O(depth) memory and O(1) amortised work per move:
+//  cyclic:   Q(m) moves m discs one step clockwise, R(m) two steps;
+//            Q(m) = R(m-1) . m . R(m-1), R(m) = R(m-1) . m . Q(m-1) . m . R(m-1)
+//  adjacent: X(m) = X(m-1) . m to 1 . X(m-1) back . m from 1 . X(m-1)
+//  double:   the classic transfer of the sizes, each move made once per disc of
+//            the size; the two discs of a size may end up swapped
+//  bicolor:  the towers on 0 and 1 end with one colour each, axis 0 keeping the
+//            colour of its bottom disc. Every other pair, from the largest one
+//            that has to change towers down, is swapped over axis 2 while the
+//            smaller pairs travel around it as a double tower, which then splits
+//            by colour, each pair over or under its top disc, whichever costs
+//            the smaller pairs less. Optimal for n <= 16 (checked against a
+//            breadth-first search), 10594 moves for n = 23
+SolutionGrammar::symbol variant_stack(SolutionGrammar& g, int variant, int n);
+// Length of that transfer, 0 if n is out of range or the discs are already in place
+uint64_t variant_moves(int variant, int n);
+
+// hanoi --moves N [--variant V] [--from K]: streams the solution of a variant
+// from move K on, one "f t" line per move, in O(n) memory
+int moves_main(int argc, char** argv);
+
+#endif